@@ -1,14 +1,20 @@
 #!/usr/bin/env python3
 import os
+import struct
+import subprocess
 from subprocess import check_output
 import re
 from time import sleep
 import pickle
+import random
 
 ALGO_MAP = {
     0: "parallel_block_sequential_sum",
     1: "parallel_block_parallel_sum",
     2: "parallel_tree_sum",
+    3: "openmp",
+    4: "std_execution_par",
+    5: "tbb_parallel_scan",
 }
 
 def run_check():
@@ -16,7 +22,7 @@ def run_check():
     THREADS = [0, 2, 6, 15]
     LOOPS = [10]
     INPUTS = ["seq_64_test.txt", "seq_63_test.txt", "8k.txt"]
-    ALGOS = [0, 1, 2]
+    ALGOS = [0, 1, 2, 3, 4, 5]
     OPTS = ["", "-s"]
 
     print("Running tests..")
@@ -41,12 +47,220 @@ def run_check():
                             raise BaseException("Results are not consistent/correct! Check {} vs {}".format(
                                 seq_file.name, file.name))
 
+def write_input(name, lines):
+    path = "temp/{}".format(name)
+    with open(path, "w") as f:
+        f.write("{}\n".format(len(lines)))
+        f.write("".join("{}\n".format(line) for line in lines))
+    return path
+
+def run_consistent(cmd, threads, expected=None, parse=lambda out: out):
+    # cmd takes the output file and thread count; every run must match the
+    # first one (and expected, if given) after parse
+    outputs = []
+    for thr in threads:
+        out_file = "temp/temp-{}.txt".format(thr)
+        print(cmd.format(out_file, thr))
+        check_output(cmd.format(out_file, thr), shell=True)
+        outputs.append(parse(open(out_file, "r").read()))
+
+    if expected is None:
+        expected = outputs[0]
+    for thr, output in zip(threads, outputs):
+        if output != expected:
+            raise BaseException("Results are not consistent/correct! Check {} with -n {}".format(
+                cmd, thr))
+
+def summed_area(vals, n_cols):
+    n_rows = len(vals) // n_cols
+    sat = [0] * len(vals)
+    for r in range(n_rows):
+        row_sum = 0
+        for c in range(n_cols):
+            i = r * n_cols + c
+            row_sum += vals[i]
+            sat[i] = row_sum + (sat[i - n_cols] if r > 0 else 0)
+    return sat
+
+def run_check_summed_area():
+    THREADS = [0, 2, 6, 15]
+    # (n, cols), including a single column and fewer rows than threads
+    SHAPES = [(64, 8), (1000, 40), (4096, 1), (1000, 1000)]
+
+    print("Running summed area tests..")
+
+    random.seed(26)
+    for n, cols in SHAPES:
+        vals = [random.randint(-100000, 100000) for _ in range(n)]
+        inp = write_input("sat-{}-{}.txt".format(n, cols), vals)
+        expected = "".join("{}\n".format(v) for v in summed_area(vals, cols))
+        for opt in ["", "-s"]:
+            cmd = "./bin/prefix_scan -m 1 -c {} -o {{}} -n {{}} -i {} {}".format(cols, inp, opt)
+            run_consistent(cmd, THREADS, expected)
+
+    # the input has to be rows x cols, a wrong -c is an error
+    inp = write_input("sat-63.txt", list(range(63)))
+    cmd = "./bin/prefix_scan -m 1 -c 8 -o temp/sat.txt -n 2 -i {}".format(inp)
+    print(cmd)
+    if subprocess.call(cmd, shell=True, stderr=subprocess.DEVNULL) == 0:
+        raise BaseException("63 values were split into rows of 8")
+
+def run_check_scan_primitives():
+    THREADS = [0, 1, 2, 6, 15]
+    SIZES = [1, 63, 64, 1000, 100003]
+    PIVOTS = [-1000001, 0, 1000001]
+
+    print("Running compact/split/radix tests..")
+
+    random.seed(27)
+    for n in SIZES:
+        vals = [random.randint(-1000000, 1000000) for _ in range(n)]
+        inp = write_input("prim-{}.txt".format(n), vals)
+        for opt in ["", "-s"]:
+            for pivot in PIVOTS:
+                kept = [v for v in vals if v < pivot]
+                rest = [v for v in vals if v >= pivot]
+                for mode, expected in [(2, kept), (3, kept + rest)]:
+                    cmd = "./bin/prefix_scan -m {} -p {} -o {{}} -n {{}} -i {} {}".format(
+                        mode, pivot, inp, opt)
+                    run_consistent(cmd, THREADS, "".join("{}\n".format(v) for v in expected))
+
+            cmd = "./bin/prefix_scan -m 4 -o {{}} -n {{}} -i {} {}".format(inp, opt)
+            run_consistent(cmd, THREADS, "".join("{}\n".format(v) for v in sorted(vals)))
+
+        # the 64-bit overload, with keys differing in every byte, sign included
+        vals64 = [random.randint(-2**63, 2**63 - 1) for _ in range(n)]
+        inp64 = write_input("prim64-{}.txt".format(n), vals64)
+        for opt in ["", "-s"]:
+            cmd = "./bin/prefix_scan -m 10 -o {{}} -n {{}} -i {} {}".format(inp64, opt)
+            run_consistent(cmd, THREADS, "".join("{}\n".format(v) for v in sorted(vals64)))
+
+def run_check_compressed():
+    THREADS = [0, 1, 2, 6, 15]
+    SIZES = [1, 63, 64, 1000, 100003]
+
+    print("Running compressed scan tests..")
+
+    random.seed(29)
+    for n in SIZES:
+        # varints of 1-5 bytes; large values are cancelled by the next one so
+        # the prefix sums don't overflow
+        vals = []
+        while len(vals) < n:
+            if random.random() < 0.5:
+                vals.append(random.randint(-64, 63))
+            else:
+                big = random.randint(-2**30, 2**30)
+                vals += [big, -big]
+        vals = vals[:n]
+        inp = write_input("plain-{}.txt".format(n), vals)
+        compressed = "temp/compressed-{}.bin".format(n)
+        cmd = "./bin/prefix_scan -m 6 -i {} -o {}".format(inp, compressed)
+        print(cmd)
+        check_output(cmd, shell=True)
+
+        cmd = "./bin/prefix_scan -o temp/plain.txt -n 0 -i {} -l 10".format(inp)
+        print(cmd)
+        check_output(cmd, shell=True)
+        expected = open("temp/plain.txt", "r").read()
+
+        for opt in ["", "-s"]:
+            cmd = "./bin/prefix_scan -o {{}} -n {{}} -i {} -l 10 {}".format(compressed, opt)
+            run_consistent(cmd, THREADS, expected)
+
+    # headers that don't match the file are rejected before they're used
+    data = open(compressed, "rb").read()
+    n_blocks = struct.unpack_from("<q", data, 16)[0]
+    for name, header in [
+            ("block-size", struct.pack("<4sIqq", b"PSVB", 0, n, n_blocks)),
+            ("n-vals", struct.pack("<4sIqq", b"PSVB", 4096, 2**40, n_blocks)),
+            ("n-blocks", struct.pack("<4sIqq", b"PSVB", 4096, n, -1)),
+            ("short", data[:24 + 16 * n_blocks - 1])]:
+        corrupt = "temp/compressed-{}.bin".format(name)
+        with open(corrupt, "wb") as f:
+            f.write(header + data[24:] if len(header) == 24 else header)
+        cmd = "./bin/prefix_scan -o temp/corrupt.txt -n 2 -i {} -l 10".format(corrupt)
+        print(cmd)
+        if subprocess.call(cmd, shell=True, stderr=subprocess.DEVNULL) == 0:
+            raise BaseException("{} was not rejected".format(corrupt))
+
+def run_check_recurrence():
+    THREADS = [0, 1, 2, 6, 15]
+    SIZES = [1, 63, 64, 1000, 100003]
+    ALGOS = [0, 1, 2]
+
+    print("Running linear recurrence tests..")
+
+    def parse(out):
+        return [float(v) for v in out.splitlines()]
+
+    random.seed(5)
+    for n in SIZES:
+        # a in {-1, 0, 1} keeps every composed map, and x, small integers,
+        # exact in doubles whatever the order the maps are composed in
+        coeffs = [(random.choice([-1, 0, 1]), random.randint(-100, 100)) for _ in range(n)]
+        inp = write_input("rec-{}.txt".format(n), ["{} {}".format(a, b) for a, b in coeffs])
+        expected = []
+        x = 0
+        for a, b in coeffs:
+            x = a * x + b
+            expected.append(float(x))
+
+        for opt in ["", "-s"]:
+            for algo in ALGOS:
+                cmd = "./bin/prefix_scan -m 5 -a {} -o {{}} -n {{}} -i {} {}".format(algo, inp, opt)
+                run_consistent(cmd, THREADS, expected, parse)
+
+def mat_mul(x, y, dim, add, mul):
+    return [add([mul(x[i * dim + k], y[k * dim + j]) for k in range(dim)])
+            for i in range(dim) for j in range(dim)]
+
+def signed_permutation(dim):
+    # exact in doubles for any product length, and not commutative
+    perm = random.sample(range(dim), dim)
+    mat = [0] * (dim * dim)
+    for i in range(dim):
+        mat[i * dim + perm[i]] = random.choice([-1, 1])
+    return mat
+
+def run_check_matrix_products():
+    THREADS = [0, 1, 2, 6, 15]
+    SIZES = [1, 63, 64, 1000]
+    ALGOS = [0, 1, 2]
+    # mode, dim, (add, mul), matrix generator
+    MODES = [
+        (7, 2, (sum, lambda a, b: a * b), lambda: signed_permutation(2)),
+        (8, 3, (sum, lambda a, b: a * b), lambda: signed_permutation(3)),
+        (9, 2, (max, lambda a, b: a + b), lambda: [random.randint(-100, 100) for _ in range(4)]),
+    ]
+
+    print("Running matrix product tests..")
+
+    def parse(out):
+        return [[float(v) for v in line.split()] for line in out.splitlines()]
+
+    random.seed(28)
+    for mode, dim, (add, mul), gen in MODES:
+        for n in SIZES:
+            mats = [gen() for _ in range(n)]
+            inp = write_input("mat-{}-{}.txt".format(mode, n),
+                              [" ".join(str(v) for v in mat) for mat in mats])
+            expected = [mats[0]]
+            for mat in mats[1:]:
+                expected.append(mat_mul(expected[-1], mat, dim, add, mul))
+
+            for opt in ["", "-s"]:
+                for algo in ALGOS:
+                    cmd = "./bin/prefix_scan -m {} -a {} -o {{}} -n {{}} -i {} {}".format(
+                        mode, algo, inp, opt)
+                    run_consistent(cmd, THREADS, expected, parse)
+
 def run_exp_1(loop, spin):
     THREADS = [2 * i for i in range(0, 17)]
     #  THREADS = [2 * i for i in range(0, 2)]
     #  LOOPS = [1]
     INPUTS = ["seq_64_test.txt", "1k.txt", "8k.txt", "16k.txt"]
-    ALGOS = [0, 1, 2]
+    ALGOS = [0, 1, 2, 3, 4, 5]
 
     print("Running experiment 1..")
 
@@ -82,7 +296,7 @@ def run_exp_2(spin):
     #  THREADS = [2 * i for i in range(0, 2)]
     #  LOOPS = [1]
     INPUTS = ["16k.txt"]
-    ALGOS = [0, 1, 2]
+    ALGOS = [0, 1, 2, 3, 4, 5]
 
     print("Running experiment 2..")
 
@@ -112,6 +326,11 @@ def run_exp_2(spin):
     pickle.dump([header] + csvs, open("results/exp_2{}.pickle".format(spin), 'wb'))
 
 run_check()
+run_check_summed_area()
+run_check_scan_primitives()
+run_check_compressed()
+run_check_recurrence()
+run_check_matrix_products()
 run_exp_1(10000, "")
 run_exp_1(10, "")
 run_exp_2("")
@@ -16,11 +16,31 @@ void get_opts(int argc,
         std::cout << "\t\t 0 = parallel_block_sequential_sum" << std::endl;
         std::cout << "\t\t 1 = parallel_block_parallel_sum" << std::endl;
         std::cout << "\t\t 2 = parallel_tree_sum" << std::endl;
+        std::cout << "\t\t 3 = openmp (mode 0 only)" << std::endl;
+        std::cout << "\t\t 4 = std_execution_par (mode 0 only)" << std::endl;
+        std::cout << "\t\t 5 = tbb_parallel_scan (mode 0 only)" << std::endl;
+        std::cout << "\t[Optional] --mode or -m (defaults to 0 = prefix_scan)" << std::endl;
+        std::cout << "\t\t 0 = prefix_scan (block-compressed inputs are detected and scanned with a fused decode+scan)" << std::endl;
+        std::cout << "\t\t 1 = summed_area_table (2D int64 scan, needs --cols)" << std::endl;
+        std::cout << "\t\t 2 = compact (keep values < pivot)" << std::endl;
+        std::cout << "\t\t 3 = split (stable partition, values < pivot first)" << std::endl;
+        std::cout << "\t\t 4 = radix_sort" << std::endl;
+        std::cout << "\t\t 5 = linear_recurrence (x_i = a_i*x_{i-1} + b_i, input lines \"a_i b_i\")" << std::endl;
+        std::cout << "\t\t 6 = compress (writes the input as block-compressed varints to --out)" << std::endl;
+        std::cout << "\t\t 7 = mat2_product (prefix products of 2x2 matrices, input lines of 4 row-major entries)" << std::endl;
+        std::cout << "\t\t 8 = mat3_product (prefix products of 3x3 matrices, input lines of 9 row-major entries)" << std::endl;
+        std::cout << "\t\t 9 = max_plus_mat2_product (prefix products of 2x2 matrices over (max, +))" << std::endl;
+        std::cout << "\t\t10 = radix_sort64 (radix_sort of 64-bit values)" << std::endl;
+        std::cout << "\t[Optional] --cols or -c <num_cols> (row-major matrix width for 2D modes)" << std::endl;
+        std::cout << "\t[Optional] --pivot or -p <pivot> (predicate pivot for compact/split, defaults to 0)" << std::endl;
         exit(0);
     }
 
     opts->spin = false;
     opts->algorithm = 0;
+    opts->mode = 0;
+    opts->n_cols = 0;
+    opts->pivot = 0;
 
     struct option l_opts[] = {
         {"in", required_argument, NULL, 'i'},
@@ -29,10 +49,13 @@ void get_opts(int argc,
         {"loops", required_argument, NULL, 'l'},
         {"spin", no_argument, NULL, 's'},
         {"algorithm", required_argument, NULL, 'a'},
+        {"mode", required_argument, NULL, 'm'},
+        {"cols", required_argument, NULL, 'c'},
+        {"pivot", required_argument, NULL, 'p'},
     };
 
     int ind, c;
-    while ((c = getopt_long(argc, argv, "i:o:n:p:l:sa:", l_opts, &ind)) != -1)
+    while ((c = getopt_long(argc, argv, "i:o:n:p:l:sa:m:c:", l_opts, &ind)) != -1)
     {
         switch (c)
         {
@@ -56,6 +79,15 @@ void get_opts(int argc,
         case 'a':
             opts->algorithm = atoi((char *)optarg);
             break;
+        case 'm':
+            opts->mode = atoi((char *)optarg);
+            break;
+        case 'c':
+            opts->n_cols = atol((char *)optarg);
+            break;
+        case 'p':
+            opts->pivot = atoi((char *)optarg);
+            break;
         case ':':
             std::cerr << argv[0] << ": option -" << (char)optopt << "requires an argument." << std::endl;
             exit(1);
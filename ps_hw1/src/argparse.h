@@ -12,6 +12,9 @@ struct options_t {
     int n_loops;
     bool spin;
     int algorithm;
+    int mode;
+    long n_cols;
+    int pivot;
 };
 
 void get_opts(int argc, char **argv, struct options_t *opts);
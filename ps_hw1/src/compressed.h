@@ -0,0 +1,77 @@
+#ifndef _COMPRESSED_H
+#define _COMPRESSED_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+// Block-compressed int input:
+//   "PSVB" | uint32 block_size | int64 n_vals | int64 n_blocks
+//   | n_blocks x (uint64 offset, int32 block_sum, int32 pad)
+//   | payload
+// every block holds block_size values (the last one may be short), each a
+// zigzag LEB128 varint starting at payload + offset. block_sum is the sum of
+// the block's values, so the carries can be scanned without decoding.
+#define COMPRESSED_MAGIC "PSVB"
+#define COMPRESSED_BLOCK_SIZE 4096
+// the longest 32 bit varint
+#define MAX_VARINT_BYTES 5
+
+struct compressed_block_t {
+  uint64_t offset;
+  int32_t  block_sum;
+  int32_t  pad;
+};
+
+struct compressed_input_t {
+  int                 n_vals;
+  int                 block_size;
+  int                 n_blocks;
+  compressed_block_t* blocks;
+  uint8_t*            payload;
+  uint64_t            payload_size;
+};
+
+struct compressed_scan_args_t {
+  const compressed_input_t* input;
+  int*               output_vals;
+  bool               spin;
+  void*              barrier;
+  int                n_threads;
+  int                t_id;
+  int (*op)(int, int, int);
+  int n_loops;
+  int*               thread_sums;
+};
+
+static inline uint8_t *encode_varint(uint8_t *dst, int val) {
+  uint32_t zigzag = ((uint32_t)val << 1) ^ (uint32_t)(val >> 31);
+
+  while (zigzag >= 0x80) {
+    *dst++ = (uint8_t)(zigzag | 0x80);
+    zigzag >>= 7;
+  }
+  *dst++ = (uint8_t)zigzag;
+
+  return dst;
+}
+
+static inline const uint8_t *decode_varint(const uint8_t *src, int *val) {
+  uint32_t zigzag = 0;
+  int shift = 0;
+
+  // stops after MAX_VARINT_BYTES even if a corrupt byte says to go on
+  uint8_t byte;
+  do {
+    byte = *src++;
+    zigzag |= (uint32_t)(byte & 0x7f) << shift;
+    shift += 7;
+  } while ((byte & 0x80) && shift < 7 * MAX_VARINT_BYTES);
+
+  *val = (int)((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+
+  return src;
+}
+
+void *compute_prefix_compressed_block_sum(void *a);
+
+#endif
@@ -1,9 +1,45 @@
 #include "helpers.h"
+#include "pthread_barrier.h"
 
 prefix_sum_args_t* alloc_args(int n_threads) {
   return (prefix_sum_args_t*) malloc(n_threads * sizeof(prefix_sum_args_t));
 }
 
+void* alloc_barrier(bool spin, int n_threads) {
+  void *barrier;
+
+  if (spin) {
+    barrier = (void *) spin_barrier_alloc();
+    spin_barrier_init((spin_barrier_t *)barrier, n_threads);
+  }
+  else {
+    barrier = (void *) alloc_pthread_barrier();
+    init_pthread_barrier((pthread_barrier_t *)barrier, n_threads);
+  }
+
+  return barrier;
+}
+
+void wait_on_barrier(bool spin, void* barrier) {
+  if (spin) {
+    spin_barrier_wait((spin_barrier_t *)barrier);
+  }
+  else {
+    pthread_barrier_wait((pthread_barrier_t *)barrier);
+  }
+}
+
+void free_barrier(bool spin, void* barrier) {
+  if (spin) {
+    spin_barrier_destroy((spin_barrier_t *)barrier);
+    free((spin_barrier_t *)barrier);
+  }
+  else {
+    pthread_barrier_destroy((pthread_barrier_t *)barrier);
+    free((pthread_barrier_t *)barrier);
+  }
+}
+
 int next_power_of_two(int x) {
     int pow = 1;
     while (pow < x) {
@@ -11,18 +47,3 @@ int next_power_of_two(int x) {
     }
     return pow;
 }
-
-void fill_args(prefix_sum_args_t *args,
-               int *inputs,
-               int *outputs,
-               bool spin,
-               void* barrier,
-               int n_threads,
-               int n_vals,
-               int (*op)(int, int, int),
-               int n_loops) {
-    for (int i = 0; i < n_threads; ++i) {
-        args[i] = {inputs, outputs, spin, barrier, n_vals,
-                   n_threads, i, op, n_loops};
-    }
-}
@@ -21,28 +21,49 @@
 #define DEBUG(x)
 #endif //DEBUG
 
-struct prefix_sum_args_t {
-  int*               input_vals;
-  int*               output_vals;
+// op(x, y) is only assumed associative: x is always the earlier (left) prefix
+template <typename T>
+struct scan_args_t {
+  T*                 input_vals;
+  T*                 output_vals;
   bool               spin;
   void*              barrier;
   int                n_vals;
   int                n_threads;
   int                t_id;
-  int (*op)(int, int, int);
+  T (*op)(T, T, int);
   int n_loops;
 };
 
+typedef scan_args_t<int> prefix_sum_args_t;
+
 prefix_sum_args_t* alloc_args(int n_threads);
 
+void* alloc_barrier(bool spin, int n_threads);
+
+void wait_on_barrier(bool spin, void* barrier);
+
+void free_barrier(bool spin, void* barrier);
+
 int next_power_of_two(int x);
 
-void fill_args(prefix_sum_args_t *args,
-               int *inputs,
-               int *outputs,
+template <typename T>
+scan_args_t<T>* alloc_scan_args(int n_threads) {
+  return (scan_args_t<T>*) malloc(n_threads * sizeof(scan_args_t<T>));
+}
+
+template <typename T>
+void fill_args(scan_args_t<T> *args,
+               T *inputs,
+               T *outputs,
                bool spin,
                void* barrier,
                int n_threads,
                int n_vals,
-               int (*op)(int, int, int),
-               int n_loops);
+               T (*op)(T, T, int),
+               int n_loops) {
+    for (int i = 0; i < n_threads; ++i) {
+        args[i] = {inputs, outputs, spin, barrier, n_vals,
+                   n_threads, i, op, n_loops};
+    }
+}
@@ -1,5 +1,9 @@
 #include "io.h"
 #include "helpers.h"
+#include <iomanip>
+#include <limits>
+#include <cstring>
+#include <algorithm>
 
 void read_file(struct options_t* args,
     int*              n_vals,
@@ -22,15 +26,202 @@ void read_file(struct options_t* args,
   }
 }
 
+void write_vals(struct options_t* args,
+    int               n_vals,
+    const int*        vals) {
+  // Open file
+  std::ofstream out;
+  out.open(args->out_file, std::ofstream::trunc);
+
+  // Write solution to output file
+  for (int i = 0; i < n_vals; ++i) {
+    out << vals[i] << std::endl;
+  }
+
+  out.flush();
+  out.close();
+}
+
 void write_file(struct options_t*         args,
-    struct prefix_sum_args_t* opts) {
+    prefix_sum_args_t* opts) {
+  write_vals(args, opts->n_vals, opts->output_vals);
+
+  // Free memory
+  free(opts->input_vals);
+  free(opts->output_vals);
+}
+
+void read_int64_file(struct options_t* args,
+    int64_t*          n_vals,
+    int64_t**         vals) {
+
+  // Open file
+  std::ifstream in;
+  in.open(args->in_file);
+  // Get num vals
+  in >> *n_vals;
+
+  // Alloc the values, sorted in place
+  *vals = (int64_t*) malloc(*n_vals * sizeof(int64_t));
+
+  // Read input vals
+  for (int64_t i = 0; i < *n_vals; ++i) {
+    in >> (*vals)[i];
+  }
+}
+
+void write_int64_vals(struct options_t* args,
+    int64_t           n_vals,
+    const int64_t*    vals) {
   // Open file
   std::ofstream out;
   out.open(args->out_file, std::ofstream::trunc);
 
   // Write solution to output file
+  for (int64_t i = 0; i < n_vals; ++i) {
+    out << vals[i] << '\n';
+  }
+
+  out.flush();
+  out.close();
+}
+
+void read_matrix_file(struct options_t* args,
+    int64_t*          n_rows,
+    int64_t*          n_cols,
+    int64_t**         input_vals,
+    int64_t**         output_vals) {
+
+  // Open file
+  std::ifstream in;
+  in.open(args->in_file);
+  // Get num vals
+  int64_t n_vals;
+  in >> n_vals;
+
+  if (args->n_cols <= 0 || n_vals < 0 || n_vals % args->n_cols != 0) {
+    std::cerr << "Error: " << n_vals << " values can't be split into rows of "
+      << args->n_cols << " columns" << std::endl;
+    exit(1);
+  }
+
+  *n_cols = args->n_cols;
+  *n_rows = n_vals / args->n_cols;
+
+  // Alloc input and output arrays
+  *input_vals = (int64_t*) malloc(n_vals * sizeof(int64_t));
+  *output_vals = (int64_t*) malloc(n_vals * sizeof(int64_t));
+
+  // Read input vals
+  for (int64_t i = 0; i < n_vals; ++i) {
+    in >> (*input_vals)[i];
+  }
+}
+
+void write_matrix_file(struct options_t*           args,
+    struct summed_area_args_t*  opts) {
+  // Open file
+  std::ofstream out;
+  out.open(args->out_file, std::ofstream::trunc);
+
+  // Write solution to output file
+  int64_t n_vals = opts->n_rows * opts->n_cols;
+  for (int64_t i = 0; i < n_vals; ++i) {
+    out << opts->output_vals[i] << '\n';
+  }
+
+  out.flush();
+  out.close();
+
+  // Free memory
+  free(opts->input_vals);
+  free(opts->output_vals);
+}
+
+void read_recurrence_file(struct options_t* args,
+    int*              n_vals,
+    affine_t**        input_vals,
+    affine_t**        output_vals) {
+
+  // Open file
+  std::ifstream in;
+  in.open(args->in_file);
+  // Get num vals
+  in >> *n_vals;
+
+  // Alloc input and output arrays
+  *input_vals = (affine_t*) malloc(*n_vals * sizeof(affine_t));
+  *output_vals = (affine_t*) malloc(*n_vals * sizeof(affine_t));
+
+  // Read input coefficients
+  for (int i = 0; i < *n_vals; ++i) {
+    in >> (*input_vals)[i].a >> (*input_vals)[i].b;
+  }
+}
+
+void write_recurrence_file(struct options_t*       args,
+    scan_args_t<affine_t>*  opts) {
+  // Open file
+  std::ofstream out;
+  out.open(args->out_file, std::ofstream::trunc);
+  out << std::setprecision(std::numeric_limits<double>::max_digits10);
+
+  // the prefix map applied to x_{-1} = 0 is just its offset
+  for (int i = 0; i < opts->n_vals; ++i) {
+    out << opts->output_vals[i].b << '\n';
+  }
+
+  out.flush();
+  out.close();
+
+  // Free memory
+  free(opts->input_vals);
+  free(opts->output_vals);
+}
+
+template <typename T>
+void read_square_matrix_file(struct options_t* args,
+    int*              n_vals,
+    T**               input_vals,
+    T**               output_vals) {
+
+  const int n_entries = sizeof(((T*)NULL)->m) / sizeof(double);
+
+  // Open file
+  std::ifstream in;
+  in.open(args->in_file);
+  // Get num vals
+  in >> *n_vals;
+
+  // Alloc input and output arrays
+  *input_vals = (T*) malloc(*n_vals * sizeof(T));
+  *output_vals = (T*) malloc(*n_vals * sizeof(T));
+
+  // Read input matrices
+  for (int i = 0; i < *n_vals; ++i) {
+    double *entries = &(*input_vals)[i].m[0][0];
+    for (int j = 0; j < n_entries; ++j) {
+      in >> entries[j];
+    }
+  }
+}
+
+template <typename T>
+void write_square_matrix_file(struct options_t*  args,
+    scan_args_t<T>*    opts) {
+
+  const int n_entries = sizeof(((T*)NULL)->m) / sizeof(double);
+
+  // Open file
+  std::ofstream out;
+  out.open(args->out_file, std::ofstream::trunc);
+  out << std::setprecision(std::numeric_limits<double>::max_digits10);
+
   for (int i = 0; i < opts->n_vals; ++i) {
-    out << opts->output_vals[i] << std::endl;
+    const double *entries = &opts->output_vals[i].m[0][0];
+    for (int j = 0; j < n_entries; ++j) {
+      out << entries[j] << (j + 1 < n_entries ? ' ' : '\n');
+    }
   }
 
   out.flush();
@@ -40,3 +231,157 @@ void write_file(struct options_t*         args,
   free(opts->input_vals);
   free(opts->output_vals);
 }
+
+#define INSTANTIATE_SQUARE_MATRIX_IO(T) \
+  template void read_square_matrix_file<T>(struct options_t*, int*, T**, T**); \
+  template void write_square_matrix_file<T>(struct options_t*, scan_args_t<T>*);
+
+INSTANTIATE_SQUARE_MATRIX_IO(mat2_t)
+INSTANTIATE_SQUARE_MATRIX_IO(mat3_t)
+INSTANTIATE_SQUARE_MATRIX_IO(max_plus_mat2_t)
+
+bool is_compressed_file(const char* file) {
+  char magic[4] = {0};
+
+  std::ifstream in;
+  in.open(file, std::ifstream::binary);
+  in.read(magic, sizeof(magic));
+
+  return in.good() && std::memcmp(magic, COMPRESSED_MAGIC, sizeof(magic)) == 0;
+}
+
+// the header fields, before any of them sizes an allocation; file_size is
+// the whole file
+static void check_compressed_header(struct options_t* args,
+    uint32_t          block_size,
+    int64_t           n_vals,
+    int64_t           n_blocks,
+    int64_t           file_size) {
+  const int64_t header_size = 4 + sizeof(block_size) + sizeof(n_vals) + sizeof(n_blocks);
+
+  if (block_size == 0 || block_size > (uint32_t)std::numeric_limits<int>::max()) {
+    std::cerr << "Error: " << args->in_file << ": bad block size " << block_size << std::endl;
+    exit(1);
+  }
+  // the scans index the values with ints
+  if (n_vals < 0 || n_vals > std::numeric_limits<int>::max()) {
+    std::cerr << "Error: " << args->in_file << ": bad number of values " << n_vals << std::endl;
+    exit(1);
+  }
+  if (n_blocks != n_vals / block_size + (n_vals % block_size == 0 ? 0 : 1)) {
+    std::cerr << "Error: " << args->in_file << ": " << n_blocks << " blocks for "
+      << n_vals << " values in blocks of " << block_size << std::endl;
+    exit(1);
+  }
+  // divided down, n_blocks * sizeof can overflow
+  if ((file_size - header_size) / (int64_t)sizeof(compressed_block_t) < n_blocks) {
+    std::cerr << "Error: " << args->in_file << ": " << file_size << " bytes, too short for "
+      << n_blocks << " block headers" << std::endl;
+    exit(1);
+  }
+}
+
+void read_compressed_file(struct options_t*    args,
+    compressed_input_t*  input) {
+
+  // Open file
+  std::ifstream in;
+  in.open(args->in_file, std::ifstream::binary);
+  in.seekg(0, std::ifstream::end);
+  int64_t file_size = in.tellg();
+  in.seekg(0);
+
+  char magic[4];
+  uint32_t block_size;
+  int64_t n_vals, n_blocks;
+  in.read(magic, sizeof(magic));
+  in.read((char *)&block_size, sizeof(block_size));
+  in.read((char *)&n_vals, sizeof(n_vals));
+  in.read((char *)&n_blocks, sizeof(n_blocks));
+
+  if (!in) {
+    std::cerr << "Error reading compressed input " << args->in_file << std::endl;
+    exit(1);
+  }
+  check_compressed_header(args, block_size, n_vals, n_blocks, file_size);
+
+  input->n_vals = (int)n_vals;
+  input->block_size = (int)block_size;
+  input->n_blocks = (int)n_blocks;
+
+  // Alloc & read block headers
+  input->blocks = (compressed_block_t*) malloc(n_blocks * sizeof(compressed_block_t));
+  in.read((char *)input->blocks, n_blocks * sizeof(compressed_block_t));
+
+  // the payload is the rest of the file
+  input->payload_size = file_size - in.tellg();
+
+  // a value decodes to at most MAX_VARINT_BYTES bytes, so a block that
+  // starts inside the payload stays inside this zeroed tail even when its
+  // bytes are corrupt
+  int64_t tail = MAX_VARINT_BYTES * std::min((int64_t)block_size, n_vals);
+  input->payload = (uint8_t*) calloc(input->payload_size + tail, 1);
+  in.read((char *)input->payload, input->payload_size);
+
+  if (!in) {
+    std::cerr << "Error reading compressed input " << args->in_file << std::endl;
+    exit(1);
+  }
+
+  for (int b = 0; b < input->n_blocks; ++b) {
+    if (input->blocks[b].offset > input->payload_size) {
+      std::cerr << "Error: " << args->in_file << ": block " << b << " starts at "
+        << input->blocks[b].offset << ", past the " << input->payload_size
+        << " byte payload" << std::endl;
+      exit(1);
+    }
+  }
+}
+
+void write_compressed_file(struct options_t* args,
+    int               n_vals,
+    const int*        vals) {
+  int64_t n_blocks = n_vals / COMPRESSED_BLOCK_SIZE +
+    (n_vals % COMPRESSED_BLOCK_SIZE == 0 ? 0 : 1);
+
+  compressed_block_t *blocks = (compressed_block_t*) malloc(n_blocks * sizeof(compressed_block_t));
+  uint8_t *payload = (uint8_t*) malloc((size_t)n_vals * MAX_VARINT_BYTES + 1);
+
+  uint8_t *dst = payload;
+  for (int64_t b = 0; b < n_blocks; ++b) {
+    int i_end = std::min((int)(b + 1) * COMPRESSED_BLOCK_SIZE, n_vals);
+    // wraps around like the int scans do
+    uint32_t block_sum = 0;
+
+    blocks[b].offset = dst - payload;
+    for (int i = b * COMPRESSED_BLOCK_SIZE; i < i_end; ++i) {
+      block_sum += (uint32_t)vals[i];
+      dst = encode_varint(dst, vals[i]);
+    }
+    blocks[b].block_sum = (int32_t)block_sum;
+    blocks[b].pad = 0;
+  }
+
+  std::ofstream out;
+  out.open(args->out_file, std::ofstream::binary | std::ofstream::trunc);
+
+  uint32_t block_size = COMPRESSED_BLOCK_SIZE;
+  int64_t n_vals_64 = n_vals;
+  out.write(COMPRESSED_MAGIC, 4);
+  out.write((char *)&block_size, sizeof(block_size));
+  out.write((char *)&n_vals_64, sizeof(n_vals_64));
+  out.write((char *)&n_blocks, sizeof(n_blocks));
+  out.write((char *)blocks, n_blocks * sizeof(compressed_block_t));
+  out.write((char *)payload, dst - payload);
+
+  out.flush();
+  out.close();
+
+  free(blocks);
+  free(payload);
+}
+
+void free_compressed_input(compressed_input_t* input) {
+  free(input->blocks);
+  free(input->payload);
+}
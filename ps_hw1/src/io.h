@@ -3,6 +3,9 @@
 
 #include "argparse.h"
 #include "prefix_sum.h"
+#include "helpers.h"
+#include "summed_area.h"
+#include "compressed.h"
 #include <iostream>
 #include <fstream>
 
@@ -11,7 +14,68 @@ void read_file(struct options_t* args,
                int**             input_vals,
                int**             output_vals);
 
+void write_vals(struct options_t* args,
+                int               n_vals,
+                const int*        vals);
+
 void write_file(struct options_t*         args,
-                struct prefix_sum_args_t* opts);
+                prefix_sum_args_t*        opts);
+
+// reads the same format as read_file, as a row-major matrix of
+// n_vals / args->n_cols rows
+void read_matrix_file(struct options_t* args,
+                      int64_t*          n_rows,
+                      int64_t*          n_cols,
+                      int64_t**         input_vals,
+                      int64_t**         output_vals);
+
+void write_matrix_file(struct options_t*           args,
+                       struct summed_area_args_t*  opts);
+
+// the same format as read_file, with 64-bit values
+void read_int64_file(struct options_t* args,
+                     int64_t*          n_vals,
+                     int64_t**         vals);
+
+void write_int64_vals(struct options_t* args,
+                      int64_t           n_vals,
+                      const int64_t*    vals);
+
+// n, then n lines of "a_i b_i" for x_i = a_i*x_{i-1} + b_i
+void read_recurrence_file(struct options_t* args,
+                          int*              n_vals,
+                          affine_t**        input_vals,
+                          affine_t**        output_vals);
+
+// writes the x_i of the scanned affine maps, x_{-1} = 0
+void write_recurrence_file(struct options_t*       args,
+                           scan_args_t<affine_t>*  opts);
+
+// n, then n lines of the row-major entries of a square matrix (mat2_t,
+// mat3_t or max_plus_mat2_t)
+template <typename T>
+void read_square_matrix_file(struct options_t* args,
+                             int*              n_vals,
+                             T**               input_vals,
+                             T**               output_vals);
+
+// writes the row-major entries of each prefix product, one per line
+template <typename T>
+void write_square_matrix_file(struct options_t*  args,
+                              scan_args_t<T>*    opts);
+
+// true if the file starts with COMPRESSED_MAGIC
+bool is_compressed_file(const char* file);
+
+// loads a block-compressed input (see compressed.h)
+void read_compressed_file(struct options_t*    args,
+                          compressed_input_t*  input);
+
+// compresses n_vals values to args->out_file
+void write_compressed_file(struct options_t* args,
+                           int               n_vals,
+                           const int*        vals);
+
+void free_compressed_input(compressed_input_t* input);
 
 #endif
@@ -9,6 +9,262 @@
 #include "operators.h"
 #include "helpers.h"
 #include "prefix_sum.h"
+#include "summed_area.h"
+#include "scan_primitives.h"
+#include "prefix_sum_backends.h"
+
+int run_summed_area(struct options_t *opts, bool sequential)
+{
+  pthread_t *threads = sequential ? NULL : alloc_threads(opts->n_threads);
+
+  // Setup args & read input data
+  summed_area_args_t *sat_args = alloc_summed_area_args(opts->n_threads);
+  int64_t n_rows, n_cols;
+  int64_t *input_vals, *output_vals;
+  read_matrix_file(opts, &n_rows, &n_cols, &input_vals, &output_vals);
+
+  void *barrier = alloc_barrier(opts->spin, opts->n_threads);
+
+  fill_summed_area_args(sat_args,
+      input_vals, output_vals,
+      opts->spin, barrier,
+      opts->n_threads, n_rows, n_cols);
+
+  // Start timer
+  auto start = std::chrono::high_resolution_clock::now();
+
+  if (sequential) {
+    DEBUG("Run sequential");
+    // a single "thread" runs all 3 phases inline
+    compute_summed_area_table((void *)sat_args);
+  }
+  else {
+    DEBUG("Run threads");
+    start_threads(threads, opts->n_threads, (void *)sat_args,
+        sizeof(summed_area_args_t), compute_summed_area_table);
+    join_threads(threads, opts->n_threads);
+  }
+
+  //End timer and print out elapsed
+  auto end = std::chrono::high_resolution_clock::now();
+  auto diff = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+  std::cout << "time: " << diff.count() << std::endl;
+
+  // Write output data
+  write_matrix_file(opts, &(sat_args[0]));
+
+  free_barrier(opts->spin, barrier);
+  free(threads);
+  free(sat_args);
+
+  return 0;
+}
+
+int run_scan_primitive(struct options_t *opts)
+{
+  // Setup args & read input data
+  prefix_sum_args_t *ps_args = alloc_args(1);
+  int n_vals;
+  int *input_vals, *output_vals;
+  read_file(opts, &n_vals, &input_vals, &output_vals);
+
+  if (opts->mode == 4) {
+    // sorted in place
+    std::memcpy(output_vals, input_vals, n_vals * sizeof(int));
+  }
+
+  // Start timer
+  auto start = std::chrono::high_resolution_clock::now();
+
+  int n_output_vals = n_vals;
+  switch (opts->mode)
+  {
+    case 2:
+      n_output_vals = parallel_compact(input_vals, output_vals, n_vals,
+          less_than, opts->pivot, opts->n_threads, opts->spin);
+      break;
+    case 3:
+      parallel_split(input_vals, output_vals, n_vals,
+          less_than, opts->pivot, opts->n_threads, opts->spin);
+      break;
+    case 4:
+      parallel_radix_sort(output_vals, n_vals, opts->n_threads, opts->spin);
+      break;
+  }
+
+  //End timer and print out elapsed
+  auto end = std::chrono::high_resolution_clock::now();
+  auto diff = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+  std::cout << "time: " << diff.count() << std::endl;
+
+  // Write output data
+  fill_args<int>(ps_args, input_vals, output_vals, opts->spin, NULL,
+      1, n_output_vals, NULL, opts->n_loops);
+  write_file(opts, &(ps_args[0]));
+
+  free(ps_args);
+
+  return 0;
+}
+
+// the 64-bit overload of parallel_radix_sort, on 64-bit values
+int run_radix_sort64(struct options_t *opts)
+{
+  int64_t n_vals;
+  int64_t *vals;
+  read_int64_file(opts, &n_vals, &vals);
+
+  // Start timer
+  auto start = std::chrono::high_resolution_clock::now();
+
+  parallel_radix_sort(vals, n_vals, opts->n_threads, opts->spin);
+
+  //End timer and print out elapsed
+  auto end = std::chrono::high_resolution_clock::now();
+  auto diff = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+  std::cout << "time: " << diff.count() << std::endl;
+
+  write_int64_vals(opts, n_vals, vals);
+  free(vals);
+
+  return 0;
+}
+
+// scans a file of operator values of type T, e.g. affine maps or matrices
+template <typename T>
+int run_operator_scan(struct options_t *opts, bool sequential,
+    T (*scan_op)(T, T, int),
+    void (*read_input)(struct options_t *, int *, T **, T **),
+    void (*write_output)(struct options_t *, scan_args_t<T> *))
+{
+  pthread_t *threads = sequential ? NULL : alloc_threads(opts->n_threads);
+
+  // Setup args & read input data
+  scan_args_t<T> *scan_args = alloc_scan_args<T>(opts->n_threads);
+  int n_vals;
+  T *input_vals, *output_vals;
+  read_input(opts, &n_vals, &input_vals, &output_vals);
+
+  void *barrier = alloc_barrier(opts->spin, opts->n_threads);
+
+  fill_args(scan_args,
+      input_vals, output_vals,
+      opts->spin, barrier,
+      opts->n_threads, n_vals,
+      scan_op, opts->n_loops);
+
+  // Start timer
+  auto start = std::chrono::high_resolution_clock::now();
+
+  if (sequential) {
+    DEBUG("Run sequential");
+    compute_prefix_sequential_sum<T>((void *)scan_args);
+  }
+  else {
+    DEBUG("Run threads");
+
+    void *(*start_routine)(void *) = NULL;
+    switch (opts->algorithm)
+    {
+      case 0:
+        start_routine = compute_prefix_parallel_block_sequential_sum<T>;
+        break;
+      case 1:
+        start_routine = compute_prefix_parallel_block_parallel_sum<T>;
+        break;
+      case 2:
+        start_routine = compute_prefix_parallel_tree_sum<T>;
+        break;
+      default:
+        std::cerr << "Algorithm " << opts->algorithm << " only supports mode 0" << std::endl;
+        exit(1);
+    }
+
+    start_threads(threads, opts->n_threads, (void *)scan_args,
+        sizeof(scan_args_t<T>), start_routine);
+    join_threads(threads, opts->n_threads);
+  }
+
+  //End timer and print out elapsed
+  auto end = std::chrono::high_resolution_clock::now();
+  auto diff = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+  std::cout << "time: " << diff.count() << std::endl;
+
+  // Write output data
+  write_output(opts, &(scan_args[0]));
+
+  free_barrier(opts->spin, barrier);
+  free(threads);
+  free(scan_args);
+
+  return 0;
+}
+
+int run_compressed_scan(struct options_t *opts, bool sequential)
+{
+  pthread_t *threads = sequential ? NULL : alloc_threads(opts->n_threads);
+
+  // Setup args & read input data
+  compressed_input_t input;
+  read_compressed_file(opts, &input);
+
+  int *output_vals = (int *)malloc(input.n_vals * sizeof(int));
+  int *thread_sums = (int *)malloc(opts->n_threads * sizeof(int));
+  compressed_scan_args_t *cs_args =
+    (compressed_scan_args_t *)malloc(opts->n_threads * sizeof(compressed_scan_args_t));
+
+  void *barrier = alloc_barrier(opts->spin, opts->n_threads);
+
+  for (int i = 0; i < opts->n_threads; ++i) {
+    cs_args[i] = {&input, output_vals, opts->spin, barrier, opts->n_threads, i,
+                  op, opts->n_loops, thread_sums};
+  }
+
+  // Start timer
+  auto start = std::chrono::high_resolution_clock::now();
+
+  if (sequential) {
+    DEBUG("Run sequential");
+    compute_prefix_compressed_block_sum((void *)cs_args);
+  }
+  else {
+    DEBUG("Run threads");
+    start_threads(threads, opts->n_threads, (void *)cs_args,
+        sizeof(compressed_scan_args_t), compute_prefix_compressed_block_sum);
+    join_threads(threads, opts->n_threads);
+  }
+
+  //End timer and print out elapsed
+  auto end = std::chrono::high_resolution_clock::now();
+  auto diff = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+  std::cout << "time: " << diff.count() << std::endl;
+
+  // Write output data
+  write_vals(opts, input.n_vals, output_vals);
+
+  free_compressed_input(&input);
+  free(output_vals);
+  free_barrier(opts->spin, barrier);
+  free(thread_sums);
+  free(threads);
+  free(cs_args);
+
+  return 0;
+}
+
+int run_compress(struct options_t *opts)
+{
+  int n_vals;
+  int *input_vals, *output_vals;
+  read_file(opts, &n_vals, &input_vals, &output_vals);
+
+  write_compressed_file(opts, n_vals, input_vals);
+
+  free(input_vals);
+  free(output_vals);
+
+  return 0;
+}
 
 int main(int argc, char **argv)
 {
@@ -22,6 +278,40 @@ int main(int argc, char **argv)
     sequential = true;
   }
 
+  if (opts.mode == 0 && is_compressed_file(opts.in_file)) {
+    return run_compressed_scan(&opts, sequential);
+  }
+  else if (opts.mode == 1) {
+    return run_summed_area(&opts, sequential);
+  }
+  else if (opts.mode >= 2 && opts.mode <= 4) {
+    // the library calls run single threaded inline for -n 0/1
+    return run_scan_primitive(&opts);
+  }
+  else if (opts.mode == 5) {
+    return run_operator_scan<affine_t>(&opts, sequential, affine_compose,
+        read_recurrence_file, write_recurrence_file);
+  }
+  else if (opts.mode == 6) {
+    return run_compress(&opts);
+  }
+  else if (opts.mode == 7) {
+    return run_operator_scan<mat2_t>(&opts, sequential, mat2_mul,
+        read_square_matrix_file<mat2_t>, write_square_matrix_file<mat2_t>);
+  }
+  else if (opts.mode == 8) {
+    return run_operator_scan<mat3_t>(&opts, sequential, mat3_mul,
+        read_square_matrix_file<mat3_t>, write_square_matrix_file<mat3_t>);
+  }
+  else if (opts.mode == 9) {
+    return run_operator_scan<max_plus_mat2_t>(&opts, sequential, max_plus_mat2_mul,
+        read_square_matrix_file<max_plus_mat2_t>, write_square_matrix_file<max_plus_mat2_t>);
+  }
+  else if (opts.mode == 10) {
+    // a library call, like modes 2-4
+    return run_radix_sort64(&opts);
+  }
+
   // Setup threads
   pthread_t *threads = sequential ? NULL : alloc_threads(opts.n_threads);;
 
@@ -37,16 +327,7 @@ int main(int argc, char **argv)
   // scan_operator = add;
 
   DEBUG("init barrier");
-  void *barrier;
-
-  if (opts.spin) {
-    barrier = (void *) spin_barrier_alloc();
-    spin_barrier_init((spin_barrier_t *)barrier, opts.n_threads);
-  }
-  else {
-    barrier = (void *) alloc_pthread_barrier();
-    init_pthread_barrier((pthread_barrier_t *)barrier, opts.n_threads);
-  }
+  void *barrier = alloc_barrier(opts.spin, opts.n_threads);
 
   fill_args(ps_args,
       input_vals, output_vals,
@@ -66,19 +347,35 @@ int main(int argc, char **argv)
       output_vals[i] = scan_operator(output_vals[i-1], input_vals[i], ps_args->n_loops);
     }
   }
+  else if (opts.algorithm >= 3) {
+    DEBUG("Run backend");
+
+    switch (opts.algorithm)
+    {
+      case 3:
+        prefix_sum_openmp(ps_args);
+        break;
+      case 4:
+        prefix_sum_std_par(ps_args);
+        break;
+      case 5:
+        prefix_sum_tbb(ps_args);
+        break;
+    }
+  }
   else {
     DEBUG("Run threads");
 
     switch (opts.algorithm)
     {
       case 0:
-        start_threads(threads, opts.n_threads, ps_args, compute_prefix_parallel_block_sequential_sum);
+        start_threads(threads, opts.n_threads, ps_args, compute_prefix_parallel_block_sequential_sum<int>);
         break;
       case 1:
-        start_threads(threads, opts.n_threads, ps_args, compute_prefix_parallel_block_parallel_sum);
+        start_threads(threads, opts.n_threads, ps_args, compute_prefix_parallel_block_parallel_sum<int>);
         break;
       case 2:
-        start_threads(threads, opts.n_threads, ps_args, compute_prefix_parallel_tree_sum);
+        start_threads(threads, opts.n_threads, ps_args, compute_prefix_parallel_tree_sum<int>);
         break;
     }
 
@@ -95,14 +392,7 @@ int main(int argc, char **argv)
   write_file(&opts, &(ps_args[0]));
 
   // Free other buffers
-  if (opts.spin) {
-    spin_barrier_destroy((spin_barrier_t *)barrier);
-    free((spin_barrier_t *)barrier);
-  }
-  else {
-    pthread_barrier_destroy((pthread_barrier_t *)barrier);
-    free((pthread_barrier_t *)barrier);
-  }
+  free_barrier(opts.spin, barrier);
   free(threads);
   free(ps_args);
 }
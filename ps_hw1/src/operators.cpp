@@ -1,4 +1,5 @@
 #include "operators.h"
+#include <algorithm>
 
 int __attribute__ ((noinline)) op(int a, int b, int n_loop) {
   volatile int acc = 0;
@@ -14,3 +15,42 @@ int add(int a, int b, int n_loop) {
   }
   return a+b;
 }
+
+bool less_than(int a, int pivot) {
+  return a < pivot;
+}
+
+affine_t affine_compose(affine_t first, affine_t then, int __) {
+  return {then.a * first.a, then.a * first.b + then.b};
+}
+
+mat2_t mat2_mul(mat2_t x, mat2_t y, int __) {
+  mat2_t r;
+  for (int i = 0; i < 2; i++) {
+    for (int j = 0; j < 2; j++) {
+      r.m[i][j] = x.m[i][0] * y.m[0][j] + x.m[i][1] * y.m[1][j];
+    }
+  }
+  return r;
+}
+
+mat3_t mat3_mul(mat3_t x, mat3_t y, int __) {
+  mat3_t r;
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      r.m[i][j] = x.m[i][0] * y.m[0][j] + x.m[i][1] * y.m[1][j] +
+        x.m[i][2] * y.m[2][j];
+    }
+  }
+  return r;
+}
+
+max_plus_mat2_t max_plus_mat2_mul(max_plus_mat2_t x, max_plus_mat2_t y, int __) {
+  max_plus_mat2_t r;
+  for (int i = 0; i < 2; i++) {
+    for (int j = 0; j < 2; j++) {
+      r.m[i][j] = std::max(x.m[i][0] + y.m[0][j], x.m[i][1] + y.m[1][j]);
+    }
+  }
+  return r;
+}
@@ -5,4 +5,37 @@
 
 
 int __attribute__ ((noinline)) op(int a, int b, int n_loop);
-int add(int a, int b, int __);
\ No newline at end of file
+int add(int a, int b, int __);
+
+// predicate for the compaction/split modes
+bool less_than(int a, int pivot);
+
+// Associative but non-commutative operators. For all of them op(x, y)
+// applies x first, i.e. x is the earlier prefix.
+
+// affine map v -> a*v + b
+struct affine_t {
+  double a;
+  double b;
+};
+
+struct mat2_t {
+  double m[2][2];
+};
+
+struct mat3_t {
+  double m[3][3];
+};
+
+// 2x2 matrix over the (max, +) semiring
+struct max_plus_mat2_t {
+  double m[2][2];
+};
+
+// then(first(v)) = then.a*(first.a*v + first.b) + then.b
+affine_t affine_compose(affine_t first, affine_t then, int __);
+
+// matrix products x*y
+mat2_t mat2_mul(mat2_t x, mat2_t y, int __);
+mat3_t mat3_mul(mat3_t x, mat3_t y, int __);
+max_plus_mat2_t max_plus_mat2_mul(max_plus_mat2_t x, max_plus_mat2_t y, int __);
@@ -1,19 +1,23 @@
 #include "prefix_sum.h"
 #include "helpers.h"
+#include "compressed.h"
+#include <algorithm>
 
-void synchronize_on_barrier(prefix_sum_args_t* args) {
-  if (args->spin) {
-    spin_barrier_wait((spin_barrier_t *)args->barrier);
-  }
-  else {
-    pthread_barrier_wait((pthread_barrier_t *)args->barrier);
-  }
+template <typename T>
+void synchronize_on_barrier(T* args) {
+  wait_on_barrier(args->spin, args->barrier);
 }
 
 // Implementation of parallel tree sum reduce/scan
 // https://www.cs.cmu.edu/afs/cs/academic/class/15750-s11/www/handouts/PrefixSumBlelloch.pdf
+template <typename T>
 void *compute_prefix_parallel_tree_sum(void *a) {
-    prefix_sum_args_t *args = (prefix_sum_args_t *)a;
+    scan_args_t<T> *args = (scan_args_t<T> *)a;
+
+    // the up-sweep copies the inputs over, but doesn't run for a single value
+    if (args->n_vals == 1 && args->t_id == 0) {
+      args->output_vals[0] = args->input_vals[0];
+    }
 
     // tree lg(p) implementation of the processor scan
     // reduce/up-sweep sums
@@ -42,9 +46,10 @@ void *compute_prefix_parallel_tree_sum(void *a) {
           }
         }
 
+        // prev_index ends the left half, keep it as the left operand
         if (dest_index < args->n_vals) {
           args->output_vals[dest_index] =
-            args->op(args->output_vals[dest_index], args->output_vals[prev_index], args->n_loops);
+            args->op(args->output_vals[prev_index], args->output_vals[dest_index], args->n_loops);
         }
       }
 
@@ -65,9 +70,10 @@ void *compute_prefix_parallel_tree_sum(void *a) {
         int reduced_index = (i + step_size) - 1;
         int dest_index = (i + step_size + offset) - 1;
 
+        // reduced_index holds the prefix before dest_index's segment
         if (dest_index < args->n_vals) {
           args->output_vals[dest_index] =
-            args->op(args->output_vals[dest_index], args->output_vals[reduced_index], args->n_loops);
+            args->op(args->output_vals[reduced_index], args->output_vals[dest_index], args->n_loops);
         }
       }
 
@@ -79,8 +85,9 @@ void *compute_prefix_parallel_tree_sum(void *a) {
 
 // Implementation of n/p blocks + parallel p processor sum reduce/scan
 // https://www.cs.cmu.edu/afs/cs/academic/class/15750-s11/www/handouts/PrefixSumBlelloch.pdf
+template <typename T>
 void *compute_prefix_parallel_block_parallel_sum(void *a) {
-    prefix_sum_args_t *args = (prefix_sum_args_t *)a;
+    scan_args_t<T> *args = (scan_args_t<T> *)a;
 
     // sum block size for each thread; has to cover all values even for uneven
     // divisions
@@ -122,9 +129,10 @@ void *compute_prefix_parallel_block_parallel_sum(void *a) {
         int dest_block_sum_index = (i + step_size) * block_size - 1;
         int prev_block_sum_index = (i + offset) * block_size - 1;
 
+        // the earlier blocks' sum is the left operand
         if (dest_block_sum_index < args->n_vals) {
           args->output_vals[dest_block_sum_index] =
-            args->op(args->output_vals[dest_block_sum_index], args->output_vals[prev_block_sum_index], args->n_loops);
+            args->op(args->output_vals[prev_block_sum_index], args->output_vals[dest_block_sum_index], args->n_loops);
         }
       }
 
@@ -148,9 +156,10 @@ void *compute_prefix_parallel_block_parallel_sum(void *a) {
         int reduced_block_sum_index = (i + step_size) * block_size - 1;
         int dest_block_sum_index = (i + step_size + offset) * block_size - 1;
 
+        // the earlier blocks' sum is the left operand
         if (dest_block_sum_index < args->n_vals) {
           args->output_vals[dest_block_sum_index] =
-            args->op(args->output_vals[dest_block_sum_index], args->output_vals[reduced_block_sum_index], args->n_loops);
+            args->op(args->output_vals[reduced_block_sum_index], args->output_vals[dest_block_sum_index], args->n_loops);
         }
       }
 
@@ -177,8 +186,9 @@ void *compute_prefix_parallel_block_parallel_sum(void *a) {
 
 // Implementation of n/p blocks + sequential p processor sum reduce/scan
 // https://www.cs.cmu.edu/afs/cs/academic/class/15750-s11/www/handouts/PrefixSumBlelloch.pdf
+template <typename T>
 void *compute_prefix_parallel_block_sequential_sum(void *a) {
-    prefix_sum_args_t *args = (prefix_sum_args_t *)a;
+    scan_args_t<T> *args = (scan_args_t<T> *)a;
 
     // sum block size for each thread; has to cover all values even for uneven
     // divisions
@@ -220,3 +230,85 @@ void *compute_prefix_parallel_block_sequential_sum(void *a) {
 
     return 0;
 }
+
+// Plain sequential scan, for the -n 0 runs of the non-int modes
+template <typename T>
+void *compute_prefix_sequential_sum(void *a) {
+    scan_args_t<T> *args = (scan_args_t<T> *)a;
+
+    if (args->n_vals > 0) {
+      args->output_vals[0] = args->input_vals[0];
+    }
+    for (int i = 1; i < args->n_vals; ++i) {
+      //y_i = y_{i-1}  <op>  x_i
+      args->output_vals[i] = args->op(args->output_vals[i-1], args->input_vals[i], args->n_loops);
+    }
+
+    return 0;
+}
+
+// n/p blocks + sequential p processor sum scan over block-compressed input;
+// the local reductions come from the block headers, so every value is
+// decoded once, in the same pass that scans it
+void *compute_prefix_compressed_block_sum(void *a) {
+    compressed_scan_args_t *args = (compressed_scan_args_t *)a;
+    const compressed_input_t *input = args->input;
+
+    // compressed blocks for each thread; has to cover all blocks even for
+    // uneven divisions
+    int block_size = input->n_blocks / args->n_threads +
+      (input->n_blocks % args->n_threads == 0 ? 0 : 1);
+
+    int t_b_partition_start = std::min(block_size * args->t_id, input->n_blocks);
+    int t_b_partition_end = std::min(t_b_partition_start + block_size, input->n_blocks);
+
+    // processor sums straight from the block headers
+    if (t_b_partition_start < t_b_partition_end) {
+      int sum = input->blocks[t_b_partition_start].block_sum;
+      for (int b = t_b_partition_start + 1; b < t_b_partition_end; ++b) {
+        sum = args->op(sum, input->blocks[b].block_sum, args->n_loops);
+      }
+      args->thread_sums[args->t_id] = sum;
+    }
+
+    synchronize_on_barrier(args);
+
+    // every thread scans the p processor sums before it on its own, that's
+    // cheaper than another barrier
+    bool has_carry = false;
+    int carry = 0;
+    for (int t = 0; t < args->t_id && t * block_size < input->n_blocks; ++t) {
+      carry = has_carry ? args->op(carry, args->thread_sums[t], args->n_loops) : args->thread_sums[t];
+      has_carry = true;
+    }
+
+    // decode + scan
+    for (int b = t_b_partition_start; b < t_b_partition_end; ++b) {
+      int i = b * input->block_size;
+      int i_end = std::min(i + input->block_size, input->n_vals);
+      const uint8_t *src = input->payload + input->blocks[b].offset;
+
+      for (; i < i_end; ++i) {
+        int val;
+        src = decode_varint(src, &val);
+        //y_i = y_{i-1}  <op>  x_i
+        carry = has_carry ? args->op(carry, val, args->n_loops) : val;
+        has_carry = true;
+        args->output_vals[i] = carry;
+      }
+    }
+
+    return 0;
+}
+
+#define INSTANTIATE_SCANS(T) \
+  template void *compute_prefix_sequential_sum<T>(void *a); \
+  template void *compute_prefix_parallel_tree_sum<T>(void *a); \
+  template void *compute_prefix_parallel_block_parallel_sum<T>(void *a); \
+  template void *compute_prefix_parallel_block_sequential_sum<T>(void *a);
+
+INSTANTIATE_SCANS(int)
+INSTANTIATE_SCANS(affine_t)
+INSTANTIATE_SCANS(mat2_t)
+INSTANTIATE_SCANS(mat3_t)
+INSTANTIATE_SCANS(max_plus_mat2_t)
@@ -5,7 +5,13 @@
 #include "spin_barrier.h"
 #include <iostream>
 
-void* compute_prefix_sum(void* a);
+// Scans over scan_args_t<T>; instantiated for int and the operator types in
+// operators.h. None of them assume op is commutative.
+template <typename T>
+void *compute_prefix_sequential_sum(void *a);
+template <typename T>
 void *compute_prefix_parallel_tree_sum(void *a);
+template <typename T>
 void *compute_prefix_parallel_block_parallel_sum(void *a);
+template <typename T>
 void *compute_prefix_parallel_block_sequential_sum(void *a);
@@ -0,0 +1,86 @@
+#include "prefix_sum_backends.h"
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <omp.h>
+#include <tbb/blocked_range.h>
+#include <tbb/global_control.h>
+#include <tbb/parallel_scan.h>
+
+void prefix_sum_openmp(prefix_sum_args_t *args) {
+  int n_vals = args->n_vals;
+  int *in = args->input_vals;
+  int *out = args->output_vals;
+
+  #pragma omp parallel num_threads(args->n_threads)
+  {
+    int n_threads = omp_get_num_threads();
+    int t_id = omp_get_thread_num();
+
+    // same n/p blocks as compute_prefix_parallel_block_sequential_sum
+    int block_size = n_vals / n_threads +
+      (n_vals % n_threads == 0 ? 0 : 1);
+
+    int t_i_partition_start = std::min(block_size * t_id, n_vals);
+    int t_i_partition_end = std::min(t_i_partition_start + block_size, n_vals);
+
+    if (t_i_partition_start < t_i_partition_end) {
+      out[t_i_partition_start] = in[t_i_partition_start];
+    }
+    for (int i = t_i_partition_start + 1; i < t_i_partition_end; ++i) {
+      out[i] = args->op(out[i-1], in[i], args->n_loops);
+    }
+
+    #pragma omp barrier
+
+    // implicit barrier at the end
+    #pragma omp single
+    {
+      for (int i = 2*block_size - 1; i < n_vals - 1 + block_size; i += block_size) {
+        int block_end = std::min(i, n_vals - 1);
+        out[block_end] = args->op(out[i-block_size], out[block_end], args->n_loops);
+      }
+    }
+
+    if (t_id > 0) {
+      for (int i = t_i_partition_start; i < t_i_partition_end - 1; ++i) {
+        out[i] = args->op(out[t_i_partition_start - 1], out[i], args->n_loops);
+      }
+    }
+  }
+}
+
+void prefix_sum_std_par(prefix_sum_args_t *args) {
+  tbb::global_control threads(tbb::global_control::max_allowed_parallelism,
+      args->n_threads);
+
+  int (*op)(int, int, int) = args->op;
+  int n_loops = args->n_loops;
+
+  std::inclusive_scan(std::execution::par,
+      args->input_vals, args->input_vals + args->n_vals,
+      args->output_vals,
+      [op, n_loops](int a, int b) { return op(a, b, n_loops); });
+}
+
+void prefix_sum_tbb(prefix_sum_args_t *args) {
+  tbb::global_control threads(tbb::global_control::max_allowed_parallelism,
+      args->n_threads);
+
+  int (*op)(int, int, int) = args->op;
+  int n_loops = args->n_loops;
+  int *in = args->input_vals;
+  int *out = args->output_vals;
+
+  tbb::parallel_scan(tbb::blocked_range<int>(0, args->n_vals), 0,
+      [=](const tbb::blocked_range<int> &range, int sum, bool is_final_scan) {
+        for (int i = range.begin(); i < range.end(); ++i) {
+          sum = op(sum, in[i], n_loops);
+          if (is_final_scan) {
+            out[i] = sum;
+          }
+        }
+        return sum;
+      },
+      [op, n_loops](int left, int right) { return op(left, right, n_loops); });
+}
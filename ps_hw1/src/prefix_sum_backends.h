@@ -0,0 +1,16 @@
+#pragma once
+
+#include "helpers.h"
+
+// Standard runtime scans to compare against the pthread ones. They take the
+// args of thread 0 and spawn their own n_threads workers; the TBB and
+// std::execution ones also take 0 as op's identity, like op and add have.
+
+// n/p blocks + sequential block sums, with an OpenMP team and barriers
+void prefix_sum_openmp(prefix_sum_args_t *args);
+
+// std::inclusive_scan(std::execution::par, ...), on libstdc++'s TBB backend
+void prefix_sum_std_par(prefix_sum_args_t *args);
+
+// tbb::parallel_scan
+void prefix_sum_tbb(prefix_sum_args_t *args);
@@ -0,0 +1,248 @@
+#include "scan_primitives.h"
+#include "helpers.h"
+#include "threads.h"
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+// n/p block of a thread; has to cover all values even for uneven divisions
+static void block_range(int64_t n_vals, int n_threads, int t_id,
+    int64_t *start, int64_t *end) {
+  int64_t block_size = n_vals / n_threads +
+    (n_vals % n_threads == 0 ? 0 : 1);
+
+  *start = std::min(block_size * t_id, n_vals);
+  *end = std::min(*start + block_size, n_vals);
+}
+
+// count the predicate matches of each block, then exclusive scan of the
+// block counts on thread 0, like compute_prefix_parallel_block_sequential_sum
+static void scan_block_matches(scan_primitive_args_t *args,
+    int64_t start, int64_t end) {
+  int count = 0;
+  for (int64_t i = start; i < end; ++i) {
+    count += args->pred(args->input_vals[i], args->pivot);
+  }
+  args->block_counts[args->t_id] = count;
+
+  wait_on_barrier(args->spin, args->barrier);
+
+  if (args->t_id == 0) {
+    int sum = 0;
+    for (int t = 0; t < args->n_threads; ++t) {
+      int block_count = args->block_counts[t];
+      args->block_counts[t] = sum;
+      sum += block_count;
+    }
+    *args->n_matches = sum;
+  }
+
+  wait_on_barrier(args->spin, args->barrier);
+}
+
+void *compute_compact(void *a) {
+  scan_primitive_args_t *args = (scan_primitive_args_t *)a;
+
+  int64_t start, end;
+  block_range(args->n_vals, args->n_threads, args->t_id, &start, &end);
+
+  scan_block_matches(args, start, end);
+
+  // scatter the matches at the block offsets
+  int out_i = args->block_counts[args->t_id];
+  for (int64_t i = start; i < end; ++i) {
+    int val = args->input_vals[i];
+    if (args->pred(val, args->pivot)) {
+      args->output_vals[out_i++] = val;
+    }
+  }
+
+  return 0;
+}
+
+void *compute_split(void *a) {
+  scan_primitive_args_t *args = (scan_primitive_args_t *)a;
+
+  int64_t start, end;
+  block_range(args->n_vals, args->n_threads, args->t_id, &start, &end);
+
+  scan_block_matches(args, start, end);
+
+  // the matches go at the block offsets, the rest after all the matches,
+  // at the block start minus the matches before it
+  int true_i = args->block_counts[args->t_id];
+  int false_i = *args->n_matches + (start - true_i);
+  for (int64_t i = start; i < end; ++i) {
+    int val = args->input_vals[i];
+    if (args->pred(val, args->pivot)) {
+      args->output_vals[true_i++] = val;
+    }
+    else {
+      args->output_vals[false_i++] = val;
+    }
+  }
+
+  return 0;
+}
+
+// radix digit of a signed key; the sign bit is flipped so negative keys
+// sort first
+template <typename K>
+static inline int radix_digit(K key, int shift) {
+  typedef typename std::make_unsigned<K>::type U;
+  const U sign_bit = (U)1 << (sizeof(K) * 8 - 1);
+
+  return (int)((((U)key ^ sign_bit) >> shift) & (RADIX_BUCKETS - 1));
+}
+
+// LSD radix sort, one RADIX_BITS digit per pass. Each pass is a block scan:
+// per-block digit histograms, a sequential exclusive scan of the
+// (digit, block) counts on thread 0 and a stable scatter of each block.
+template <typename K>
+void *compute_radix_sort(void *a) {
+  radix_sort_args_t<K> *args = (radix_sort_args_t<K> *)a;
+
+  int64_t start, end;
+  block_range(args->n_vals, args->n_threads, args->t_id, &start, &end);
+
+  K *src = args->keys;
+  K *dst = args->tmp_keys;
+  int64_t *histogram = args->histograms + args->t_id * RADIX_BUCKETS;
+
+  for (int shift = 0; shift < (int)sizeof(K) * 8; shift += RADIX_BITS) {
+    int64_t local_histogram[RADIX_BUCKETS] = {0};
+    for (int64_t i = start; i < end; ++i) {
+      local_histogram[radix_digit(src[i], shift)]++;
+    }
+    std::memcpy(histogram, local_histogram, sizeof(local_histogram));
+
+    wait_on_barrier(args->spin, args->barrier);
+
+    // exclusive scan, digit-major so equal digits keep the block order
+    if (args->t_id == 0) {
+      int64_t sum = 0;
+      bool skip = false;
+
+      for (int digit = 0; digit < RADIX_BUCKETS; ++digit) {
+        int64_t digit_count = 0;
+        for (int t = 0; t < args->n_threads; ++t) {
+          int64_t count = args->histograms[t * RADIX_BUCKETS + digit];
+          args->histograms[t * RADIX_BUCKETS + digit] = sum;
+          sum += count;
+          digit_count += count;
+        }
+        // all keys share this digit, the pass wouldn't move anything
+        skip = skip || digit_count == args->n_vals;
+      }
+      *args->skip_pass = skip;
+    }
+
+    wait_on_barrier(args->spin, args->barrier);
+
+    // thread 0 only resets skip_pass after the next histogram barrier
+    if (*args->skip_pass) {
+      continue;
+    }
+
+    for (int64_t i = start; i < end; ++i) {
+      K key = src[i];
+      dst[histogram[radix_digit(key, shift)]++] = key;
+    }
+
+    wait_on_barrier(args->spin, args->barrier);
+
+    std::swap(src, dst);
+  }
+
+  // odd number of passes done, the result is in tmp_keys
+  if (src != args->keys) {
+    std::memcpy(args->keys + start, src + start, (end - start) * sizeof(K));
+  }
+
+  return 0;
+}
+
+template void *compute_radix_sort<int32_t>(void *a);
+template void *compute_radix_sort<int64_t>(void *a);
+
+// runs start_routine on n_threads threads, or inline for a single thread
+static void run_threads(int n_threads, void *args, size_t args_size,
+    void *(*start_routine)(void *)) {
+  if (n_threads == 1) {
+    start_routine(args);
+    return ;
+  }
+
+  pthread_t *threads = alloc_threads(n_threads);
+  start_threads(threads, n_threads, args, args_size, start_routine);
+  join_threads(threads, n_threads);
+  free(threads);
+}
+
+static int run_scan_primitive(const int *in, int *out, int n_vals,
+    bool (*pred)(int, int), int pivot, int n_threads, bool spin,
+    void *(*start_routine)(void *)) {
+  scan_primitive_args_t *args =
+    (scan_primitive_args_t *)malloc(n_threads * sizeof(scan_primitive_args_t));
+  int *block_counts = (int *)malloc(n_threads * sizeof(int));
+  int n_matches = 0;
+  void *barrier = alloc_barrier(spin, n_threads);
+
+  for (int i = 0; i < n_threads; ++i) {
+    args[i] = {in, out, spin, barrier, n_vals, n_threads, i,
+               pred, pivot, block_counts, &n_matches};
+  }
+
+  run_threads(n_threads, (void *)args, sizeof(scan_primitive_args_t), start_routine);
+
+  free_barrier(spin, barrier);
+  free(block_counts);
+  free(args);
+
+  return n_matches;
+}
+
+int parallel_compact(const int *in, int *out, int n_vals,
+                     bool (*pred)(int, int), int pivot,
+                     int n_threads, bool spin) {
+  return run_scan_primitive(in, out, n_vals, pred, pivot, n_threads, spin,
+      compute_compact);
+}
+
+int parallel_split(const int *in, int *out, int n_vals,
+                   bool (*pred)(int, int), int pivot,
+                   int n_threads, bool spin) {
+  return run_scan_primitive(in, out, n_vals, pred, pivot, n_threads, spin,
+      compute_split);
+}
+
+template <typename K>
+static void run_radix_sort(K *keys, int64_t n_vals, int n_threads, bool spin) {
+  radix_sort_args_t<K> *args =
+    (radix_sort_args_t<K> *)malloc(n_threads * sizeof(radix_sort_args_t<K>));
+  K *tmp_keys = (K *)malloc(n_vals * sizeof(K));
+  int64_t *histograms = (int64_t *)malloc(n_threads * RADIX_BUCKETS * sizeof(int64_t));
+  bool skip_pass = false;
+  void *barrier = alloc_barrier(spin, n_threads);
+
+  for (int i = 0; i < n_threads; ++i) {
+    args[i] = {keys, tmp_keys, spin, barrier, n_vals, n_threads, i,
+               histograms, &skip_pass};
+  }
+
+  run_threads(n_threads, (void *)args, sizeof(radix_sort_args_t<K>),
+      compute_radix_sort<K>);
+
+  free_barrier(spin, barrier);
+  free(histograms);
+  free(tmp_keys);
+  free(args);
+}
+
+void parallel_radix_sort(int32_t *keys, int64_t n_vals, int n_threads, bool spin) {
+  run_radix_sort(keys, n_vals, n_threads, spin);
+}
+
+void parallel_radix_sort(int64_t *keys, int64_t n_vals, int n_threads, bool spin) {
+  run_radix_sort(keys, n_vals, n_threads, spin);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "spin_barrier.h"
+#include <iostream>
+
+// radix sort digit width; 8 bits = 256 buckets, so the per-thread
+// histograms stay in L1
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+// args for compaction and split; both are a block count of the predicate
+// matches, a sequential exclusive scan of the block counts and a scatter
+struct scan_primitive_args_t {
+  const int*         input_vals;
+  int*               output_vals;
+  bool               spin;
+  void*              barrier;
+  int                n_vals;
+  int                n_threads;
+  int                t_id;
+  bool (*pred)(int, int);
+  int                pivot;
+  int*               block_counts;
+  int*               n_matches;
+};
+
+template <typename K>
+struct radix_sort_args_t {
+  K*                 keys;
+  K*                 tmp_keys;
+  bool               spin;
+  void*              barrier;
+  int64_t            n_vals;
+  int                n_threads;
+  int                t_id;
+  int64_t*           histograms;
+  bool*              skip_pass;
+};
+
+void *compute_compact(void *a);
+void *compute_split(void *a);
+template <typename K>
+void *compute_radix_sort(void *a);
+
+// Library calls; these set up their own barrier and threads (none for
+// n_threads == 1)
+
+// writes the values of in matching pred(value, pivot) to out, in order;
+// returns the number of matches
+int parallel_compact(const int *in, int *out, int n_vals,
+                     bool (*pred)(int, int), int pivot,
+                     int n_threads, bool spin);
+
+// stable partition of in into out, values matching pred(value, pivot) first;
+// returns the number of matches, i.e. the start of the second partition
+int parallel_split(const int *in, int *out, int n_vals,
+                   bool (*pred)(int, int), int pivot,
+                   int n_threads, bool spin);
+
+// in-place LSD radix sort of signed keys
+void parallel_radix_sort(int32_t *keys, int64_t n_vals, int n_threads, bool spin);
+void parallel_radix_sort(int64_t *keys, int64_t n_vals, int n_threads, bool spin);
@@ -0,0 +1,116 @@
+#include "summed_area.h"
+#include "helpers.h"
+#include <algorithm>
+
+summed_area_args_t* alloc_summed_area_args(int n_threads) {
+  return (summed_area_args_t*) malloc(n_threads * sizeof(summed_area_args_t));
+}
+
+void fill_summed_area_args(summed_area_args_t *args,
+                           int64_t *inputs,
+                           int64_t *outputs,
+                           bool spin,
+                           void* barrier,
+                           int n_threads,
+                           int64_t n_rows,
+                           int64_t n_cols) {
+    for (int i = 0; i < n_threads; ++i) {
+        args[i] = {inputs, outputs, spin, barrier, n_rows, n_cols,
+                   n_threads, i};
+    }
+}
+
+// 2D inclusive scan (summed-area table / integral image) of a row-major
+// n_rows x n_cols matrix:
+//   out[r][c] = sum of in[0..r][0..c]
+//
+// Same shape as compute_prefix_parallel_block_sequential_sum, but the blocks
+// are bands of whole rows and the "values" being scanned are rows:
+// 1. every thread scans its band of rows, both along the rows and down the
+//    band, in a single row-major pass; the last row of each band is the band
+//    sum
+// 2. the band sums are scanned down the bands, split over the threads by
+//    column tiles
+// 3. every thread adds the scanned band sum above it into its band, tile by
+//    tile so the carry row stays in cache
+// There are no strided column walks, every pass streams whole rows.
+void *compute_summed_area_table(void *a) {
+    summed_area_args_t *args = (summed_area_args_t *)a;
+
+    int64_t n_rows = args->n_rows;
+    int64_t n_cols = args->n_cols;
+    int64_t *in = args->input_vals;
+    int64_t *out = args->output_vals;
+
+    // row band size for each thread; has to cover all rows even for uneven
+    // divisions
+    int64_t block_size = n_rows / args->n_threads +
+      (n_rows % args->n_threads == 0 ? 0 : 1);
+
+    int64_t t_r_partition_start = block_size * args->t_id;
+    int64_t t_r_partition_end = std::min(t_r_partition_start + block_size, n_rows);
+
+    // scan rows, accumulating down the band
+    for (int64_t r = t_r_partition_start; r < t_r_partition_end; ++r) {
+      int64_t *in_row = in + r * n_cols;
+      int64_t *out_row = out + r * n_cols;
+      int64_t row_sum = 0;
+
+      if (r == t_r_partition_start) {
+        for (int64_t c = 0; c < n_cols; ++c) {
+          row_sum += in_row[c];
+          out_row[c] = row_sum;
+        }
+      }
+      else {
+        int64_t *prev_row = out_row - n_cols;
+
+        for (int64_t c = 0; c < n_cols; ++c) {
+          row_sum += in_row[c];
+          out_row[c] = row_sum + prev_row[c];
+        }
+      }
+    }
+
+    wait_on_barrier(args->spin, args->barrier);
+
+    // sequential scan of the band sums (last row of each band), with the
+    // columns split between the threads
+    int64_t col_block_size = n_cols / args->n_threads +
+      (n_cols % args->n_threads == 0 ? 0 : 1);
+    int64_t t_c_partition_start = col_block_size * args->t_id;
+    int64_t t_c_partition_end = std::min(t_c_partition_start + col_block_size, n_cols);
+
+    for (int64_t r = 2*block_size - 1; r < n_rows - 1 + block_size; r += block_size) {
+      int64_t band_end = std::min(r, n_rows - 1);
+      int64_t *out_row = out + band_end * n_cols;
+      int64_t *carry_row = out + (r - block_size) * n_cols;
+
+      for (int64_t c = t_c_partition_start; c < t_c_partition_end; ++c) {
+        out_row[c] += carry_row[c];
+      }
+    }
+
+    wait_on_barrier(args->spin, args->barrier);
+
+    // incorporate the scanned band sum above into each band
+    // the first band is already processed, and the last row of each band was
+    // handled above
+    if (args->t_id > 0 && t_r_partition_start < n_rows) {
+      int64_t *carry_row = out + (t_r_partition_start - 1) * n_cols;
+
+      for (int64_t c_tile = 0; c_tile < n_cols; c_tile += SAT_TILE_COLS) {
+        int64_t c_tile_end = std::min(c_tile + SAT_TILE_COLS, n_cols);
+
+        for (int64_t r = t_r_partition_start; r < t_r_partition_end - 1; ++r) {
+          int64_t *out_row = out + r * n_cols;
+
+          for (int64_t c = c_tile; c < c_tile_end; ++c) {
+            out_row[c] += carry_row[c];
+          }
+        }
+      }
+    }
+
+    return 0;
+}
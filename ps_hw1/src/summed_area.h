@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "spin_barrier.h"
+#include <iostream>
+
+// width (in values) of the column tiles used when carrying block sums down
+// the rows; 512 int64s = 4KB, so a carry tile stays in L1
+#define SAT_TILE_COLS 512
+
+struct summed_area_args_t {
+  int64_t*           input_vals;
+  int64_t*           output_vals;
+  bool               spin;
+  void*              barrier;
+  int64_t            n_rows;
+  int64_t            n_cols;
+  int                n_threads;
+  int                t_id;
+};
+
+summed_area_args_t* alloc_summed_area_args(int n_threads);
+
+void fill_summed_area_args(summed_area_args_t *args,
+                           int64_t *inputs,
+                           int64_t *outputs,
+                           bool spin,
+                           void* barrier,
+                           int n_threads,
+                           int64_t n_rows,
+                           int64_t n_cols);
+
+void *compute_summed_area_table(void *a);
@@ -8,12 +8,20 @@ pthread_t *alloc_threads(int n_threads)
 
 void start_threads(pthread_t *threads,
                    int n_threads,
-                   struct prefix_sum_args_t *args,
+                   prefix_sum_args_t *args,
+                   void *(*start_routine)(void *)) {
+  start_threads(threads, n_threads, (void *)args, sizeof(prefix_sum_args_t), start_routine);
+}
+
+void start_threads(pthread_t *threads,
+                   int n_threads,
+                   void *args,
+                   size_t args_size,
                    void *(*start_routine)(void *)) {
   int ret = 0;
   for (int i = 0; i < n_threads; ++i) {
     ret |= pthread_create(&(threads[i]), NULL, start_routine,
-                          (void *)&(args[i]));
+                          (void *)((char *)args + i * args_size));
   }
 
   if (ret) {
@@ -12,7 +12,14 @@ pthread_t* alloc_threads(int n_threads);
 
 void start_threads(pthread_t*               threads,
                   int                       n_threads,
-                  struct prefix_sum_args_t* args,
+                  prefix_sum_args_t*        args,
+                  void* (*start_routine) (void*));
+
+// same as above, for any per-thread args array with elements of args_size
+void start_threads(pthread_t*               threads,
+                  int                       n_threads,
+                  void*                     args,
+                  size_t                    args_size,
                   void* (*start_routine) (void*));
 
 void join_threads(pthread_t* threads,
@@ -0,0 +1,370 @@
+// Benchmarks the k-means algorithms on Gaussian blobs generated in memory,
+// over a grid of n, d, k and spread, and prints one CSV or JSON row per run.
+//
+// The phase times are the algorithms' own, from phases.h; the GPU algorithms
+// don't time their phases and leave them empty. The "sequential/<kernel>"
+// rows run -a 0 on each nearest centroid kernel.
+
+#include <chrono>
+#include <cmath>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "common.h"
+#include "argparse.h"
+#include "phases.h"
+#include "seed.h"
+#include "k_means_sequential.h"
+#include "k_means_kernels.h"
+#include "k_means_cpu.h"
+#include "k_means_bounds.h"
+#include "k_means_minibatch.h"
+#include "k_means_kdtree.h"
+#include "k_means_ivf.h"
+#include "k_means_thrust.h"
+#include "k_means_cuda.h"
+
+// algorithm ids of -a; the sequential rows of the other assign kernels are
+// KERNELS + the kernel
+#define KERNELS 100
+
+struct bench_opts_t {
+  std::vector<int> n, d, k, algorithms;
+  std::vector<double> spread;
+  int warmup, repeats;
+  int n_threads;
+  int max_iterations;
+  real threshold;
+  int seed;
+  bool json;
+};
+
+struct bench_result_t {
+  int iterations;
+  double total_ms;
+  phase_times_t phases;
+};
+
+static double now_ms() {
+  return std::chrono::duration<double, std::milli>(
+      std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+// splitmix64
+static unsigned long next_random(unsigned long *state) {
+  unsigned long z = (*state += 0x9E3779B97F4A7C15UL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+  return z ^ (z >> 31);
+}
+
+static double uniform(unsigned long *state) {
+  return (next_random(state) >> 11) * (1.0 / (1UL << 53));
+}
+
+// n points around k centers uniform in [-10, 10]^d, with a normal spread
+// (Box-Muller) in every dimension
+static real *generate_blobs(int n, int d, int k, double spread, int seed) {
+  unsigned long state = seed;
+  real *centers = (real *)malloc(k * d * sizeof(real));
+  real *points = (real *)malloc((long)n * d * sizeof(real));
+
+  for (int i = 0; i < k * d; i++) {
+    centers[i] = 20 * uniform(&state) - 10;
+  }
+
+  for (int i = 0; i < n; i++) {
+    int c = next_random(&state) % k;
+
+    for (int l = 0; l < d; l++) {
+      double u_1 = 1 - uniform(&state), u_2 = uniform(&state);
+      double normal = sqrt(-2 * log(u_1)) * cos(2 * M_PI * u_2);
+      points[(long)i*d + l] = centers[c*d + l] + spread * normal;
+    }
+  }
+
+  free(centers);
+  return points;
+}
+
+static const char *algorithm_name(int algorithm) {
+  switch (algorithm)
+  {
+    case 0: return "sequential";
+    case 1: return "thrust";
+    case 2: return "cuda";
+    case 3: return "cuda shmem";
+    case 4: return "cpu";
+    case 5: return "bounds";
+    case 6: return "mini-batch";
+    case 7: return "kd-tree";
+    case 10: return "ivf";
+    case KERNELS + 0: return "sequential/direct";
+    case KERNELS + 1: return "sequential/scalar";
+    case KERNELS + 2: return "sequential/gemm";
+    // out-of-core and MPI read a file, not the generated points
+    default: return NULL;
+  }
+}
+
+static bench_result_t run(int algorithm, int n_points, real *points,
+    struct options_t *opts) {
+  bench_result_t result;
+  memset(&result, 0, sizeof(result));
+
+  int *ids = (int *)malloc(n_points * sizeof(int));
+  real *centroids = (real *)malloc(opts->n_clusters * opts->dimensions * sizeof(real));
+  k_means_init_random_centroids(n_points, opts->dimensions, points,
+      opts->n_clusters, centroids, opts->seed);
+
+  double per_iteration_time = 0;
+  reset_phase_times();
+  double start = now_ms();
+
+  switch (algorithm)
+  {
+    case 0:
+      result.iterations = k_means_sequential(n_points, points, opts, ids, &centroids);
+      break;
+    case 1:
+      result.iterations = k_means_thrust(n_points, points, opts, ids, &centroids, &per_iteration_time);
+      break;
+    case 2:
+    case 3:
+      result.iterations = k_means_cuda(n_points, points, opts, ids, &centroids, &per_iteration_time);
+      break;
+    case 4:
+      result.iterations = k_means_cpu(n_points, points, opts, ids, &centroids);
+      break;
+    case 5:
+      result.iterations = k_means_bounds(n_points, points, opts, ids, &centroids);
+      break;
+    case 6:
+      result.iterations = k_means_minibatch(n_points, points, opts, ids, &centroids);
+      break;
+    case 7:
+      result.iterations = k_means_kdtree(n_points, points, opts, ids, &centroids);
+      break;
+    case 10:
+      result.iterations = k_means_ivf(n_points, points, opts, ids, &centroids);
+      break;
+    default:
+      opts->assign = algorithm - KERNELS;
+      result.iterations = k_means_sequential(n_points, points, opts, ids, &centroids);
+      opts->assign = 0;
+  }
+
+  result.total_ms = now_ms() - start;
+  result.phases = phase_times;
+
+  free(ids);
+  free(centroids);
+  return result;
+}
+
+static void print_row(const bench_opts_t *bench, bool *first, int algorithm,
+    int n, int d, int k, double spread, int repeat, int batch_size,
+    bench_result_t *result) {
+  bool phases = algorithm < 1 || algorithm > 3;
+  // distance evaluations (points * centroids * dims) per second, over the
+  // points an iteration visits: all of them, or a batch for mini-batch
+  int n_visited = algorithm == 6 && batch_size < n ? batch_size : n;
+  double rate = (double)n_visited * k * d * result->iterations / (result->total_ms / 1000);
+
+  if (!bench->json) {
+    printf("%s,%d,%d,%d,%g,%d,%d,%f,%f,", algorithm_name(algorithm), n, d, k,
+        spread, repeat, result->iterations, result->total_ms,
+        result->total_ms / result->iterations);
+    if (phases) {
+      printf("%f,%f,%f,", result->phases.assign_ms, result->phases.update_ms,
+          result->phases.check_ms);
+    }
+    else {
+      printf(",,,");
+    }
+    printf("%g\n", rate);
+    return ;
+  }
+
+  printf("%s\n  {\"algorithm\": \"%s\", \"n\": %d, \"d\": %d, \"k\": %d, "
+      "\"spread\": %g, \"repeat\": %d, \"iterations\": %d, \"total_ms\": %f, "
+      "\"per_iteration_ms\": %f, ", *first ? "[" : ",", algorithm_name(algorithm),
+      n, d, k, spread, repeat, result->iterations, result->total_ms,
+      result->total_ms / result->iterations);
+  if (phases) {
+    printf("\"assign_ms\": %f, \"update_ms\": %f, \"check_ms\": %f, ",
+        result->phases.assign_ms, result->phases.update_ms, result->phases.check_ms);
+  }
+  else {
+    printf("\"assign_ms\": null, \"update_ms\": null, \"check_ms\": null, ");
+  }
+  printf("\"distances_per_s\": %g}", rate);
+  *first = false;
+}
+
+template <typename T>
+static std::vector<T> parse_list(const char *arg) {
+  std::vector<T> values;
+  char *list = strdup(arg);
+
+  for (char *value = strtok(list, ","); value != NULL; value = strtok(NULL, ",")) {
+    values.push_back((T)atof(value));
+  }
+
+  free(list);
+  return values;
+}
+
+static void get_bench_opts(int argc, char **argv, bench_opts_t *bench) {
+  bench->n = parse_list<int>("100000");
+  bench->d = parse_list<int>("4,32");
+  bench->k = parse_list<int>("8,64");
+  bench->spread = parse_list<double>("1");
+  bench->algorithms = parse_list<int>("0,4,5,7,100,102");
+  bench->warmup = 1;
+  bench->repeats = 3;
+  bench->n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  bench->max_iterations = 100;
+  bench->threshold = 1e-5;
+  bench->seed = 8675309;
+  bench->json = false;
+
+  struct option l_opts[] = {
+    {"points", required_argument, NULL, 'N'},
+    {"dimensions", required_argument, NULL, 'd'},
+    {"n_clusters", required_argument, NULL, 'k'},
+    {"spread", required_argument, NULL, 'p'},
+    {"algorithms", required_argument, NULL, 'a'},
+    {"warmup", required_argument, NULL, 'w'},
+    {"repeats", required_argument, NULL, 'r'},
+    {"n_threads", required_argument, NULL, 'n'},
+    {"max_iterations", required_argument, NULL, 'm'},
+    {"threshold", required_argument, NULL, 't'},
+    {"seed", required_argument, NULL, 's'},
+    {"json", no_argument, NULL, 'j'},
+    {"help", no_argument, NULL, 'h'},
+    {0, 0, 0, 0},
+  };
+
+  int ind, c;
+  while ((c = getopt_long(argc, argv, "N:d:k:p:a:w:r:n:m:t:s:jh", l_opts, &ind)) != -1)
+  {
+    switch (c)
+    {
+    case 'N':
+      bench->n = parse_list<int>(optarg);
+      break;
+    case 'd':
+      bench->d = parse_list<int>(optarg);
+      break;
+    case 'k':
+      bench->k = parse_list<int>(optarg);
+      break;
+    case 'p':
+      bench->spread = parse_list<double>(optarg);
+      break;
+    case 'a':
+      bench->algorithms = parse_list<int>(optarg);
+      break;
+    case 'w':
+      bench->warmup = atoi(optarg);
+      break;
+    case 'r':
+      bench->repeats = atoi(optarg);
+      break;
+    case 'n':
+      bench->n_threads = atoi(optarg);
+      break;
+    case 'm':
+      bench->max_iterations = atoi(optarg);
+      break;
+    case 't':
+      bench->threshold = atof(optarg);
+      break;
+    case 's':
+      bench->seed = atoi(optarg);
+      break;
+    case 'j':
+      bench->json = true;
+      break;
+    default:
+      std::cout << "Usage: " << argv[0] << " [options], lists are comma separated" << std::endl;
+      std::cout << "\t--points or -N <n list> (defaults to 100000)" << std::endl;
+      std::cout << "\t--dimensions or -d <d list> (defaults to 4,32)" << std::endl;
+      std::cout << "\t--n_clusters or -k <k list> (defaults to 8,64)" << std::endl;
+      std::cout << "\t--spread or -p <blob standard deviation list> (defaults to 1)" << std::endl;
+      std::cout << "\t--algorithms or -a <-a list> (defaults to 0,4,5,7,100,102)" << std::endl;
+      std::cout << "\t\t 0-7 and 10 as in kmeans -a (not 8 and 9, they read files)" << std::endl;
+      std::cout << "\t\t 100 + <-g> = sequential on that assign kernel" << std::endl;
+      std::cout << "\t--warmup or -w <runs> (defaults to 1)" << std::endl;
+      std::cout << "\t--repeats or -r <runs> (defaults to 3)" << std::endl;
+      std::cout << "\t--n_threads or -n <n_threads> (defaults to all cores)" << std::endl;
+      std::cout << "\t--max_iterations or -m, --threshold or -t, --seed or -s" << std::endl;
+      std::cout << "\t--json or -j (JSON instead of CSV)" << std::endl;
+      exit(c == 'h' ? 0 : 1);
+    }
+  }
+
+  for (size_t i = 0; i < bench->algorithms.size(); i++) {
+    if (algorithm_name(bench->algorithms[i]) == NULL) {
+      std::cerr << argv[0] << ": unknown algorithm " << bench->algorithms[i] << std::endl;
+      exit(1);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  bench_opts_t bench;
+  get_bench_opts(argc, argv, &bench);
+
+  bool first = true;
+  if (!bench.json) {
+    printf("algorithm,n,d,k,spread,repeat,iterations,total_ms,per_iteration_ms,"
+        "assign_ms,update_ms,check_ms,distances_per_s\n");
+  }
+
+  for (size_t i_n = 0; i_n < bench.n.size(); i_n++)
+  for (size_t i_d = 0; i_d < bench.d.size(); i_d++)
+  for (size_t i_k = 0; i_k < bench.k.size(); i_k++)
+  for (size_t i_s = 0; i_s < bench.spread.size(); i_s++) {
+    int n = bench.n[i_n], d = bench.d[i_d], k = bench.k[i_k];
+    double spread = bench.spread[i_s];
+    real *points = generate_blobs(n, d, k, spread, bench.seed);
+
+    struct options_t opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.n_clusters = k;
+    opts.dimensions = d;
+    opts.max_iterations = bench.max_iterations;
+    opts.threshold = bench.threshold;
+    opts.seed = bench.seed;
+    opts.n_threads = bench.n_threads;
+    opts.batch_size = 1024;
+    opts.restarts = 1;
+    opts.recall = 0.95;
+
+    for (size_t i_a = 0; i_a < bench.algorithms.size(); i_a++) {
+      int algorithm = bench.algorithms[i_a];
+      opts.algorithm = algorithm;
+
+      for (int w = 0; w < bench.warmup; w++) {
+        run(algorithm, n, points, &opts);
+      }
+
+      for (int r = 0; r < bench.repeats; r++) {
+        bench_result_t result = run(algorithm, n, points, &opts);
+        print_row(&bench, &first, algorithm, n, d, k, spread, r, opts.batch_size, &result);
+      }
+      fflush(stdout);
+    }
+
+    free(points);
+  }
+
+  if (bench.json) {
+    printf("%s\n", first ? "[]" : "\n]");
+  }
+}
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+import os
+import random
+from subprocess import check_output
+
+# Checks the algorithms that should agree with the sequential one (-a 0) on
+# generated blobs. Needs bin/kmeans: make compile, or make thrust_omp on a
+# machine without a GPU.
+KMEANS = "./bin/kmeans"
+SEED = 8675309
+
+# n, d, k of the generated inputs
+INPUTS = [(4000, 2, 3), (3000, 8, 6), (5000, 24, 16), (2000, 16, 64)]
+THREADS = [1, 2, 6, 15]
+
+def write_blobs(n, d, k):
+    # k gaussian blobs with unit variance, centers in [-10, 10]^d
+    rng = random.Random(n * d * k)
+    centers = [[rng.uniform(-10, 10) for _ in range(d)] for _ in range(k)]
+    path = "temp/blobs-{}-{}-{}.txt".format(n, d, k)
+    with open(path, "w") as f:
+        f.write("{}\n".format(n))
+        for i in range(n):
+            center = centers[rng.randrange(k)]
+            f.write("{} {}\n".format(i, " ".join("{:.6f}".format(rng.gauss(c, 1)) for c in center)))
+    return path
+
+def run_kmeans(path, d, k, opts):
+    # the iterations, the ids and the centroids, without the time
+    cmd = "{} -i {} -d {} -k {} -m 200 -t 0.00001 -s {} {}".format(
+        KMEANS, path, d, k, SEED, opts)
+    print(cmd)
+    ids = check_output(cmd, shell=True).decode("ascii").split("\n")
+    centroids = check_output(cmd + " -c", shell=True).decode("ascii").split("\n")
+    iterations = ids[0].split(",")[0]
+    return iterations, ids[1:], [[float(x) for x in line.split()[1:]] for line in centroids[1:] if line]
+
+def matches(result, expected):
+    # the same ids, and centroids up to rounding, for updates summed in
+    # another order; the rounding can also take the convergence check past
+    # the threshold an iteration earlier or later
+    if result[1] != expected[1] or len(result[2]) != len(expected[2]):
+        return False
+    return all(abs(x - y) <= 1e-4 * max(1, abs(y))
+               for r, e in zip(result[2], expected[2]) for x, y in zip(r, e))
+
+def check(result, expected, same, path, opts):
+    if (result != expected) if same else not matches(result, expected):
+        raise BaseException("Results are not consistent/correct! Check {} on {}".format(opts, path))
+
+def run_check_cpu(inputs):
+    # -a 4 sums fixed slices of the points in a fixed tree, so the thread
+    # count doesn't change the result, but the tree rounds unlike -a 0
+    print("Running cpu tests..")
+    for path, d, k in inputs:
+        single = run_kmeans(path, d, k, "-a 4 -n 1")
+        check(single, run_kmeans(path, d, k, "-a 0"), False, path, "-a 4 -n 1")
+        for thr in THREADS[1:]:
+            check(run_kmeans(path, d, k, "-a 4 -n {}".format(thr)), single, True, path,
+                  "-a 4 -n {}".format(thr))
+
+def run_check_exact(inputs):
+    # pruning and incremental updates must not change the assignment
+    OPTS = ["-a 5 -b 0", "-a 5 -b 1", "-a 5 -b 2", "-a 10 -Q 1", "-a 0 -r 1", "-a 0 -r 4"]
+
+    print("Running exact tests..")
+    for path, d, k in inputs:
+        expected = run_kmeans(path, d, k, "-a 0")
+        for opts in OPTS:
+            check(run_kmeans(path, d, k, opts), expected, False, path, opts)
+
+def run_check_restarts(inputs):
+    # each restart has its own generator, so -R doesn't depend on -n either
+    print("Running restart tests..")
+    for path, d, k in inputs:
+        expected = run_kmeans(path, d, k, "-R 4 -n 1")
+        for thr in THREADS[1:]:
+            check(run_kmeans(path, d, k, "-R 4 -n {}".format(thr)), expected, True, path,
+                  "-R 4 -n {}".format(thr))
+
+os.makedirs("temp", exist_ok=True)
+inputs = [(write_blobs(n, d, k), d, k) for n, d, k in INPUTS]
+run_check_cpu(inputs)
+run_check_exact(inputs)
+run_check_restarts(inputs)
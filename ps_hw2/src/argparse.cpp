@@ -1,4 +1,7 @@
 #include "argparse.h"
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
 
 void get_opts(int argc,
               char **argv,
@@ -8,24 +11,100 @@ void get_opts(int argc,
     {
         std::cout << "Usage:" << std::endl;
         std::cout << "\t--n_clusters or -k <n_clusters>" << std::endl;
+        std::cout << "\t[Optional] --k-range or -K <k_min>:<k_max> (instead of -k, prints k,inertia,iterations per k; k_min is seeded by -I, every next k splits the previous solution)" << std::endl;
         std::cout << "\t--dimensions or -d <dimensions>" << std::endl;
         std::cout << "\t--in or -i <file_path>" << std::endl;
         std::cout << "\t--max_iterations or -m <max_iterations>" << std::endl;
         std::cout << "\t--threshold or -t <threshold>" << std::endl;
         std::cout << "\t[Optional] --print-centroids or -c" << std::endl;
+        std::cout << "\t[Optional] --out or -o <file_path> (the results to a file instead of stdout)" << std::endl;
+        std::cout << "\t[Optional] --binary or -w (the ids as raw int32s, or with -c the centroids as raw reals," << std::endl;
+        std::cout << "\t\t the iterations,time line still on stdout)" << std::endl;
+        std::cout << "\t[Optional] --sparse or -p (\"index col:val ...\" lines, algorithms 0 and 4, random init only, no -R or -K)" << std::endl;
+        std::cout << "\t[Optional] --convert or -x <out_file> (write the points as a binary dataset and exit)" << std::endl;
         std::cout << "\t--seed or -s" << std::endl;
+        std::cout << "\t[Optional] --init or -I (defaults to 0 = random)" << std::endl;
+        std::cout << "\t\t 0 = random points" << std::endl;
+        std::cout << "\t\t 1 = k-means++" << std::endl;
+        std::cout << "\t\t 2 = k-means|| (multi-threaded)" << std::endl;
         std::cout << "\t[Optional] --algorithm or -a (defaults to 0 = sequential)" << std::endl; //TODO
         std::cout << "\t\t 0 = sequential" << std::endl;
         std::cout << "\t\t 1 = thrust" << std::endl;
         std::cout << "\t\t 2 = cuda" << std::endl;
+        std::cout << "\t\t 3 = cuda shmem" << std::endl;
+        std::cout << "\t\t 4 = cpu (multi-threaded)" << std::endl;
+        std::cout << "\t\t 5 = bounds (triangle inequality pruning)" << std::endl;
+        std::cout << "\t\t 6 = mini-batch" << std::endl;
+        std::cout << "\t\t 7 = kd-tree filtering (low dimensions)" << std::endl;
+        std::cout << "\t\t 8 = out-of-core (points streamed from the file, random init only;" << std::endl;
+        std::cout << "\t\t     a text file is parsed again every iteration, -x converts it to binary)" << std::endl;
+        std::cout << "\t\t 9 = MPI (make mpi, run with mpiexec, random init only)" << std::endl;
+        std::cout << "\t\t10 = ivf (approximate assignment, for very large k)" << std::endl;
+        std::cout << "\t[Optional] --n_threads or -n <n_threads> (cpu algorithms, defaults to all cores)" << std::endl;
+        std::cout << "\t[Optional] --assign or -g (cpu algorithms, defaults to 0 = direct)" << std::endl;
+        std::cout << "\t\t 0 = direct (SIMD)" << std::endl;
+        std::cout << "\t\t 1 = scalar" << std::endl;
+        std::cout << "\t\t 2 = gemm (||x||^2 - 2x.c + ||c||^2, for large k and d)" << std::endl;
+        std::cout << "\t[Optional] --bounds or -b (bounds algorithm, defaults to 0 = auto from k and d)" << std::endl;
+        std::cout << "\t\t 0 = auto" << std::endl;
+        std::cout << "\t\t 1 = Hamerly" << std::endl;
+        std::cout << "\t\t 2 = Elkan" << std::endl;
+        std::cout << "\t[Optional] --recompute or -r <iterations> (sequential, defaults to 0 = off)" << std::endl;
+        std::cout << "\t\t incremental centroid updates from the reassigned points," << std::endl;
+        std::cout << "\t\t with the sums recomputed every <iterations>" << std::endl;
+        std::cout << "\t[Optional] --restarts or -R <restarts> (sequential, not with -K, defaults to 1)" << std::endl;
+        std::cout << "\t\t runs with seeds seed .. seed + restarts - 1 on the threads," << std::endl;
+        std::cout << "\t\t keeping the one with the lowest inertia" << std::endl;
+        std::cout << "\t[Optional] --recall or -Q <recall> (ivf, defaults to 0.95, 1 = exact)" << std::endl;
+        std::cout << "\t\t lists probed so that this fraction of the points find their exact" << std::endl;
+        std::cout << "\t\t nearest centroid; ambiguous points are searched further" << std::endl;
+        std::cout << "\t[Optional] --batch_size or -B <batch_size> (mini-batch, defaults to 1024)" << std::endl;
+        std::cout << "\t[Optional] --chunk_size or -C <chunk_size> (out-of-core, points per read, defaults to 262144)" << std::endl;
+        std::cout << "\t[Optional] --stream or -S (mini-batch, stream the points from the file, random init only)" << std::endl;
+        std::cout << "\t\t binary files are sampled, text files are read in order, convert them with -x" << std::endl;
+        std::cout << "   or: " << argv[0] << " predict (assign points to trained centroids)" << std::endl;
+        std::cout << "\t--dimensions or -d <dimensions>" << std::endl;
+        std::cout << "\t--in or -i <file_path> (the points)" << std::endl;
+        std::cout << "\t--centroids or -l <file_path> (the output of -c, or a binary dataset)" << std::endl;
+        std::cout << "\t[Optional] --out or -o, --binary or -w, as above, for the ids" << std::endl;
+        std::cout << "\t[Optional] --distances or -D <file_path> (the squared distances as raw reals)" << std::endl;
+        std::cout << "\t[Optional] --n_threads or -n, --assign or -g, as above" << std::endl;
         exit(0);
     }
 
+    opts->predict = false;
+    if (strcmp(argv[1], "predict") == 0) {
+        // parsed from the subcommand on, like a command of its own
+        opts->predict = true;
+        argc--;
+        argv++;
+    }
+
+    opts->n_clusters = 0;
+    opts->k_min = 0;
+    opts->k_max = 0;
     opts->print_centroids = false;
     opts->algorithm = 0;
+    opts->n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    opts->assign = 0;
+    opts->bounds = 0;
+    opts->batch_size = 1024;
+    opts->chunk_size = 262144;
+    opts->stream = false;
+    opts->init = 0;
+    opts->recompute = 0;
+    opts->restarts = 1;
+    opts->convert = NULL;
+    opts->sparse = false;
+    opts->recall = 0.95;
+    opts->centroids = NULL;
+    opts->out = NULL;
+    opts->binary_out = false;
+    opts->distances = NULL;
 
     struct option l_opts[] = {
         {"n_clusters", required_argument, NULL, 'k'},
+        {"k-range", required_argument, NULL, 'K'},
         {"dimensions", required_argument, NULL, 'd'},
         {"in", required_argument, NULL, 'i'},
         {"max_iterations", required_argument, NULL, 'm'},
@@ -33,10 +112,27 @@ void get_opts(int argc,
         {"print-centroids", no_argument, NULL, 'c'},
         {"seed", required_argument, NULL, 's'},
         {"algorithm", optional_argument, NULL, 'a'},
+        {"n_threads", required_argument, NULL, 'n'},
+        {"assign", required_argument, NULL, 'g'},
+        {"bounds", required_argument, NULL, 'b'},
+        {"batch_size", required_argument, NULL, 'B'},
+        {"chunk_size", required_argument, NULL, 'C'},
+        {"stream", no_argument, NULL, 'S'},
+        {"init", required_argument, NULL, 'I'},
+        {"recompute", required_argument, NULL, 'r'},
+        {"restarts", required_argument, NULL, 'R'},
+        {"convert", required_argument, NULL, 'x'},
+        {"sparse", no_argument, NULL, 'p'},
+        {"recall", required_argument, NULL, 'Q'},
+        {"centroids", required_argument, NULL, 'l'},
+        {"out", required_argument, NULL, 'o'},
+        {"distances", required_argument, NULL, 'D'},
+        {"binary", no_argument, NULL, 'w'},
+        {0, 0, 0, 0},
     };
 
     int ind, c;
-    while ((c = getopt_long(argc, argv, "k:d:i:m:t:cs:a:", l_opts, &ind)) != -1)
+    while ((c = getopt_long(argc, argv, "k:K:d:i:m:t:cs:a:n:g:b:B:C:SI:r:R:x:pQ:l:o:D:w", l_opts, &ind)) != -1)
     {
         switch (c)
         {
@@ -45,6 +141,15 @@ void get_opts(int argc,
         case 'k':
             opts->n_clusters = atoi((char *)optarg);
             break;
+        case 'K':
+            if (sscanf((char *)optarg, "%d:%d", &opts->k_min, &opts->k_max) != 2) {
+                opts->k_max = opts->k_min;
+            }
+            if (opts->k_min < 1 || opts->k_max < opts->k_min) {
+                std::cerr << argv[0] << ": bad k range " << optarg << std::endl;
+                exit(1);
+            }
+            break;
         case 'd':
             opts->dimensions = atoi((char *)optarg);
             break;
@@ -66,6 +171,66 @@ void get_opts(int argc,
         case 'a':
             opts->algorithm = atoi((char *)optarg);
             break;
+        case 'n':
+            opts->n_threads = atoi((char *)optarg);
+            if (opts->n_threads < 1) {
+                std::cerr << argv[0] << ": -n needs at least one thread, not " << optarg << std::endl;
+                exit(1);
+            }
+            break;
+        case 'g':
+            opts->assign = atoi((char *)optarg);
+            break;
+        case 'b':
+            opts->bounds = atoi((char *)optarg);
+            break;
+        case 'B':
+            opts->batch_size = atoi((char *)optarg);
+            break;
+        case 'C':
+            opts->chunk_size = atoi((char *)optarg);
+            if (opts->chunk_size < 1) {
+                std::cerr << argv[0] << ": -C needs at least one point per read, not " << optarg << std::endl;
+                exit(1);
+            }
+            break;
+        case 'S':
+            opts->stream = true;
+            break;
+        case 'I':
+            opts->init = atoi((char *)optarg);
+            break;
+        case 'r':
+            opts->recompute = atoi((char *)optarg);
+            break;
+        case 'R':
+            opts->restarts = atoi((char *)optarg);
+            if (opts->restarts < 1) {
+                std::cerr << argv[0] << ": -R needs at least one run, not " << optarg << std::endl;
+                exit(1);
+            }
+            break;
+        case 'x':
+            opts->convert = (char *)optarg;
+            break;
+        case 'p':
+            opts->sparse = true;
+            break;
+        case 'Q':
+            opts->recall = atof((char *)optarg);
+            break;
+        case 'l':
+            opts->centroids = (char *)optarg;
+            break;
+        case 'o':
+            opts->out = (char *)optarg;
+            break;
+        case 'D':
+            opts->distances = (char *)optarg;
+            break;
+        case 'w':
+            opts->binary_out = true;
+            break;
         case ':':
             std::cerr << argv[0] << ": option -" << (char)optopt << "requires an argument." << std::endl;
             exit(1);
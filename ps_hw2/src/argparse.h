@@ -7,6 +7,8 @@
 
 struct options_t {
     int n_clusters;
+    // --k-range, 0 when not sweeping
+    int k_min, k_max;
     int dimensions;
     char *in_file;
     int max_iterations;
@@ -14,6 +16,25 @@ struct options_t {
     bool print_centroids;
     int seed;
     int algorithm;
+    int n_threads;
+    int assign;
+    int bounds;
+    int batch_size;
+    int chunk_size;
+    bool stream;
+    int init;
+    int recompute;
+    int restarts;
+    char *convert;
+    bool sparse;
+    real recall;
+    // kmeans predict
+    bool predict;
+    char *centroids;
+    char *distances;
+    // results to a file, raw
+    char *out;
+    bool binary_out;
 };
 
 void get_opts(int argc, char **argv, struct options_t *opts);
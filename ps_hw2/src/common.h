@@ -23,6 +23,17 @@
 
 #define POW2(x) (x)*(x)
 
+#define HANDLE(x) \
+  do { \
+    int res = x; \
+    if (res) {\
+      std::cerr << "[" << __FILE__ << "][" << __FUNCTION__ << "][Line " << __LINE__ << "] "\
+        << #x << " " << strerror(res) << std::endl;\
+      exit(1);\
+    }\
+  } while (0) \
+
+
 #ifdef REAL_FLOAT
 using real = float;
 #else
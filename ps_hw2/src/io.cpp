@@ -1,26 +1,668 @@
 #include "io.h"
 #include "common.h"
+#include <algorithm>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-void read_file(struct options_t* args, int* n_points, real** points) {
+// the mapping read_binary_file handed out as points, if any
+static void *mapped = NULL;
+static size_t mapped_size = 0;
+
+static bool is_binary_file(const char *path) {
+  char magic[4] = {0};
+
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    return false;
+  }
+  size_t n_read = fread(magic, 1, sizeof(magic), f);
+  fclose(f);
+
+  return n_read == sizeof(magic) && std::memcmp(magic, BINARY_MAGIC, sizeof(magic)) == 0;
+}
+
+// file_size is the whole file, header included
+static void check_binary_header(struct options_t* args, const binary_header_t* header,
+    long file_size) {
+  if (header->dtype != 4 && header->dtype != 8) {
+    std::cerr << args->in_file << ": bad dtype " << header->dtype << std::endl;
+    exit(1);
+  }
+  if (header->n <= 0 || header->n > std::numeric_limits<int>::max() ||
+      header->d <= 0 || header->d > std::numeric_limits<int>::max()) {
+    std::cerr << args->in_file << ": bad shape " << header->n << " x "
+      << header->d << std::endl;
+    exit(1);
+  }
+  if (header->d != args->dimensions) {
+    std::cerr << args->in_file << ": " << header->d << " dimensions, expected "
+      << args->dimensions << std::endl;
+    exit(1);
+  }
+  // divided down, n*d*dtype can overflow
+  if ((file_size - (long)sizeof(binary_header_t)) / header->dtype / header->d < header->n) {
+    std::cerr << args->in_file << ": " << file_size << " bytes, too short for "
+      << header->n << " points" << std::endl;
+    exit(1);
+  }
+}
+
+static void check_binary_size(struct options_t* args, long file_size) {
+  if (file_size < (long)sizeof(binary_header_t)) {
+    std::cerr << args->in_file << ": " << file_size << " bytes, too short for a header"
+      << std::endl;
+    exit(1);
+  }
+}
+
+// mmaps the file; the payload is used as the points in place when it has the
+// width of real, and converted otherwise
+static void read_binary_file(struct options_t* args, int* n_points, real** points) {
+  int fd = open(args->in_file, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    std::cerr << args->in_file << ": " << strerror(errno) << std::endl;
+    exit(1);
+  }
+  check_binary_size(args, st.st_size);
+
+  // private and writable, so the points can be modified like a malloc'd copy
+  void *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    std::cerr << args->in_file << ": " << strerror(errno) << std::endl;
+    exit(1);
+  }
+  madvise(base, st.st_size, MADV_WILLNEED);
+
+  const binary_header_t *header = (const binary_header_t *)base;
+  check_binary_header(args, header, st.st_size);
+  *n_points = (int)header->n;
+
+  char *payload = (char *)base + sizeof(binary_header_t);
+  long n_vals = header->n * header->d;
+
+  if (header->dtype == sizeof(real)) {
+    *points = (real *)payload;
+    mapped = base;
+    mapped_size = st.st_size;
+    return ;
+  }
+
+  *points = (real *)malloc(n_vals * sizeof(real));
+  for (long i = 0; i < n_vals; i++) {
+    (*points)[i] = header->dtype == 4 ? (real)((float *)payload)[i] : (real)((double *)payload)[i];
+  }
+  munmap(base, st.st_size);
+}
+
+struct parse_args_t {
+  // [start, end) of the text, on line boundaries
+  const char *start, *end;
+  int d;
+  int n_points;
+  real *points;
+  // index of the chunk's first point, and the number of points in it
+  int first_point;
+  // index in the file of points[0], for the errors
+  int first_index;
+  int n_lines;
+  // sparse files: the chunk's nonzeros, and the index of the first one
+  long n_nonzeros, first_nonzero;
+  csr_points_t *csr;
+};
+
+static inline real strto_real(const char *s, char **end) {
+#ifdef REAL_FLOAT
+  return strtof(s, end);
+#else
+  return strtod(s, end);
+#endif
+}
+
+static bool blank_line(const char *c, const char *end) {
+  for (; c < end && *c != '\n'; c++) {
+    if (!isspace(*c)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static const char *next_line(const char *c, const char *end) {
+  const char *newline = (const char *)memchr(c, '\n', end - c);
+  return newline == NULL ? end : newline + 1;
+}
+
+static void *count_lines(void *a) {
+  parse_args_t *args = (parse_args_t *)a;
+
+  args->n_lines = 0;
+  for (const char *c = args->start; c < args->end; c = next_line(c, args->end)) {
+    args->n_lines += !blank_line(c, args->end);
+  }
 
-  // Open file
-  std::ifstream in;
-  in.open(args->in_file);
-  // Get num vals
-  in >> *n_points;
+  return 0;
+}
 
-  // Alloc input and output arrays
-  *points = (real*) malloc(*n_points * args->dimensions * sizeof(real));
+// each line is "index x_1 ... x_d"
+static void *parse_lines(void *a) {
+  parse_args_t *args = (parse_args_t *)a;
+  int d = args->d;
+  int i = args->first_point;
 
-  int index;
+  for (const char *c = args->start; c < args->end && i < args->n_points; c = next_line(c, args->end)) {
+    if (blank_line(c, args->end)) {
+      continue;
+    }
 
-  // Read input vals
-  for (int i = 0; i < (*n_points) * args->dimensions; ++i) {
-    in >> index;
-    in >> (*points)[i];
+    char *field;
+    strtol(c, &field, 10);
+    // strto_real skips newlines, a short line would take the next line's
+    // values
+    const char *newline = (const char *)memchr(c, '\n', args->end - c);
+    bool parsed = true;
+    for (int l = 0; l < d; l++) {
+      char *value = field;
+      args->points[(long)i*d + l] = strto_real(value, &field);
+      parsed = parsed && field != value;
+    }
+    if (!parsed || (newline != NULL && field > newline)) {
+      std::cerr << "point " << args->first_index + i << ": fewer than " << d << " values" << std::endl;
+      exit(1);
+    }
+    i++;
+  }
+
+  return 0;
+}
+
+// the whole file in memory, NUL terminated for strto_real at the end
+static char *slurp(const char *path, long *size) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    std::cerr << path << ": " << strerror(errno) << std::endl;
+    exit(1);
+  }
+  fseek(f, 0, SEEK_END);
+  *size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  char *text = (char *)malloc(*size + 1);
+  *size = fread(text, 1, *size, f);
+  text[*size] = '\0';
+  fclose(f);
+
+  return text;
+}
+
+// cuts [data, end) in n_threads chunks of lines
+static parse_args_t *split_lines(const char *data, const char *end, int n_threads) {
+  parse_args_t *chunks = (parse_args_t *)malloc(n_threads * sizeof(parse_args_t));
+
+  for (int t = 0; t < n_threads; t++) {
+    const char *start = data + (end - data) * t / n_threads;
+    // a chunk starts at the line after the cut, the previous one takes the
+    // line the cut is in
+    chunks[t].start = t == 0 ? data : next_line(start - 1, end);
+  }
+  for (int t = 0; t < n_threads; t++) {
+    chunks[t].end = t == n_threads - 1 ? end : chunks[t + 1].start;
+  }
+
+  return chunks;
+}
+
+static void run_chunks(parse_args_t *chunks, int n_threads, void *(*op)(void *)) {
+  pthread_t *threads = (pthread_t *)malloc(n_threads * sizeof(pthread_t));
+
+  for (int t = 0; t < n_threads; t++) {
+    HANDLE(pthread_create(&threads[t], NULL, op, (void *)&chunks[t]));
+  }
+  for (int t = 0; t < n_threads; t++) {
+    HANDLE(pthread_join(threads[t], NULL));
+  }
+
+  free(threads);
+}
+
+// the threads count their chunk's lines, then parse them into their place in
+// points
+static void read_text_file(struct options_t* args, int* n_points, real** points) {
+  long size;
+  char *text = slurp(args->in_file, &size);
+
+  char *c;
+  *n_points = (int)strtol(text, &c, 10);
+  const char *data = next_line(c, text + size);
+  const char *end = text + size;
+
+  *points = (real *)malloc((long)*n_points * args->dimensions * sizeof(real));
+
+  int n_threads = args->n_threads > 0 ? args->n_threads : 1;
+  parse_args_t *chunks = split_lines(data, end, n_threads);
+
+  for (int t = 0; t < n_threads; t++) {
+    chunks[t].d = args->dimensions;
+    chunks[t].n_points = *n_points;
+    chunks[t].points = *points;
+    chunks[t].first_index = 0;
+  }
+
+  run_chunks(chunks, n_threads, count_lines);
+
+  int n_lines = 0;
+  for (int t = 0; t < n_threads; t++) {
+    chunks[t].first_point = n_lines;
+    n_lines += chunks[t].n_lines;
+  }
+  if (n_lines < *n_points) {
+    std::cerr << args->in_file << ": " << n_lines << " points, expected "
+      << *n_points << std::endl;
+    exit(1);
+  }
+
+  run_chunks(chunks, n_threads, parse_lines);
+
+  free(chunks);
+  free(text);
+}
+
+// a nonzero per "col:val" field
+static void *count_sparse_lines(void *a) {
+  parse_args_t *args = (parse_args_t *)a;
+
+  args->n_lines = 0;
+  args->n_nonzeros = 0;
+  for (const char *c = args->start; c < args->end; c = next_line(c, args->end)) {
+    if (blank_line(c, args->end)) {
+      continue;
+    }
+
+    args->n_lines++;
+    for (; c < args->end && *c != '\n'; c++) {
+      args->n_nonzeros += *c == ':';
+    }
+  }
+
+  return 0;
+}
+
+// each line is "index col:val col:val ...", with 0-based columns
+static void *parse_sparse_lines(void *a) {
+  parse_args_t *args = (parse_args_t *)a;
+  csr_points_t *csr = args->csr;
+  int i = args->first_point;
+  long nz = args->first_nonzero;
+
+  for (const char *c = args->start; c < args->end && i < args->n_points; c = next_line(c, args->end)) {
+    if (blank_line(c, args->end)) {
+      continue;
+    }
+
+    csr->row_start[i] = nz;
+
+    char *field;
+    strtol(c, &field, 10);
+    const char *line_end = next_line(c, args->end);
+    while (true) {
+      char *colon;
+      long col = strtol(field, &colon, 10);
+      if (colon == field || colon >= line_end || *colon != ':') {
+        break;
+      }
+      if (col < 0 || col >= args->d) {
+        std::cerr << "point " << i << ": column " << col << " out of "
+          << args->d << " dimensions" << std::endl;
+        exit(1);
+      }
+
+      csr->cols[nz] = (int)col;
+      csr->vals[nz] = strto_real(colon + 1, &field);
+      nz++;
+    }
+    i++;
+  }
+
+  // the end of the last point
+  if (i == args->n_points && i > args->first_point) {
+    csr->row_start[i] = nz;
+  }
+
+  return 0;
+}
+
+// same chunks as read_text_file; the nonzero counts are summed along the
+// chunks to place every chunk's rows
+void read_sparse_file(struct options_t* args, csr_points_t* points) {
+  long size;
+  char *text = slurp(args->in_file, &size);
+
+  char *c;
+  points->n_points = (int)strtol(text, &c, 10);
+  points->d = args->dimensions;
+  const char *data = next_line(c, text + size);
+  const char *end = text + size;
+
+  int n_threads = args->n_threads > 0 ? args->n_threads : 1;
+  parse_args_t *chunks = split_lines(data, end, n_threads);
+
+  for (int t = 0; t < n_threads; t++) {
+    chunks[t].d = args->dimensions;
+    chunks[t].n_points = points->n_points;
+    chunks[t].csr = points;
+  }
+
+  run_chunks(chunks, n_threads, count_sparse_lines);
+
+  int n_lines = 0;
+  long nnz = 0;
+  for (int t = 0; t < n_threads; t++) {
+    chunks[t].first_point = n_lines;
+    chunks[t].first_nonzero = nnz;
+    n_lines += chunks[t].n_lines;
+    nnz += chunks[t].n_nonzeros;
+  }
+  if (n_lines < points->n_points) {
+    std::cerr << args->in_file << ": " << n_lines << " points, expected "
+      << points->n_points << std::endl;
+    exit(1);
+  }
+
+  points->row_start = (long *)malloc(((long)points->n_points + 1) * sizeof(long));
+  points->cols = (int *)malloc(nnz * sizeof(int));
+  points->vals = (real *)malloc(nnz * sizeof(real));
+  // moved back by the chunk of the last point if there are more lines
+  points->row_start[points->n_points] = nnz;
+
+  run_chunks(chunks, n_threads, parse_sparse_lines);
+
+  points->nnz = points->row_start[points->n_points];
+  DEBUG_OUT(points->nnz);
+
+  free(chunks);
+  free(text);
+}
+
+void free_csr_points(csr_points_t* points) {
+  free(points->row_start);
+  free(points->cols);
+  free(points->vals);
+}
+
+void read_file(struct options_t* args, int* n_points, real** points) {
+  if (is_binary_file(args->in_file)) {
+    read_binary_file(args, n_points, points);
+  }
+  else {
+    read_text_file(args, n_points, points);
   }
 
-  DEBUG_OUT(index);
   DEBUG_OUT((*points)[0]);
-  DEBUG_OUT((*points)[*n_points * args->dimensions - 1]);
+  DEBUG_OUT((*points)[(long)*n_points * args->dimensions - 1]);
+}
+
+void free_points(real* points) {
+  if (mapped != NULL && (char *)points == (char *)mapped + sizeof(binary_header_t)) {
+    munmap(mapped, mapped_size);
+    mapped = NULL;
+    return ;
+  }
+
+  free(points);
+}
+
+void write_binary_file(const char* path, int n_points, int d, const real* points) {
+  FILE *f = fopen(path, "wb");
+  if (f == NULL) {
+    std::cerr << path << ": " << strerror(errno) << std::endl;
+    exit(1);
+  }
+
+  binary_header_t header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, BINARY_MAGIC, sizeof(header.magic));
+  header.dtype = sizeof(real);
+  header.n = n_points;
+  header.d = d;
+
+  fwrite(&header, sizeof(header), 1, f);
+  fwrite(points, sizeof(real), (long)n_points * d, f);
+  fclose(f);
+}
+
+void read_centroids(struct options_t* args, int* k, real** centroids) {
+  struct options_t centroid_args = *args;
+  centroid_args.in_file = args->centroids;
+
+  if (is_binary_file(args->centroids)) {
+    // copied, the points may be mapped too
+    real *mapped_centroids;
+    read_binary_file(&centroid_args, k, &mapped_centroids);
+    *centroids = (real *)malloc((long)*k * args->dimensions * sizeof(real));
+    std::memcpy(*centroids, mapped_centroids, (long)*k * args->dimensions * sizeof(real));
+    free_points(mapped_centroids);
+    return ;
+  }
+
+  long size;
+  char *text = slurp(args->centroids, &size);
+  const char *end = text + size;
+  int d = args->dimensions;
+
+  *k = 0;
+  for (const char *c = text; c < end; c = next_line(c, end)) {
+    (*k)++;
+  }
+  *centroids = (real *)malloc((long)*k * d * sizeof(real));
+
+  *k = 0;
+  for (const char *c = text; c < end; c = next_line(c, end)) {
+    char *field;
+    strtol(c, &field, 10);
+    // the "iterations,time" line
+    if (field == c || *field == ',') {
+      continue;
+    }
+
+    const char *line_end = next_line(c, end);
+    int l = 0;
+    for (; l < d; l++) {
+      char *value_end;
+      real value = strto_real(field, &value_end);
+      if (value_end == field || value_end > line_end) {
+        break;
+      }
+      (*centroids)[(long)*k*d + l] = value;
+      field = value_end;
+    }
+    if (l < d || !blank_line(field, end)) {
+      std::cerr << args->centroids << ": centroid " << *k << " doesn't have "
+        << d << " dimensions" << std::endl;
+      exit(1);
+    }
+    (*k)++;
+  }
+
+  free(text);
+}
+
+void write_raw_file(const char* path, const void* data, size_t size) {
+  FILE *f = fopen(path, "wb");
+  if (f == NULL || fwrite(data, 1, size, f) != size) {
+    std::cerr << path << ": " << strerror(errno) << std::endl;
+    exit(1);
+  }
+  fclose(f);
+}
+
+void open_point_stream(struct options_t* args, point_stream_t* stream) {
+  stream->path = args->in_file;
+  stream->d = args->dimensions;
+  stream->n_threads = args->n_threads > 0 ? args->n_threads : 1;
+  stream->binary = is_binary_file(args->in_file);
+  stream->in.open(args->in_file, std::ios::binary);
+  if (!stream->in) {
+    std::cerr << args->in_file << ": " << strerror(errno) << std::endl;
+    exit(1);
+  }
+
+  if (stream->binary) {
+    struct stat st;
+    if (stat(args->in_file, &st) != 0) {
+      std::cerr << args->in_file << ": " << strerror(errno) << std::endl;
+      exit(1);
+    }
+    check_binary_size(args, st.st_size);
+
+    binary_header_t header;
+    stream->in.read((char *)&header, sizeof(header));
+    check_binary_header(args, &header, st.st_size);
+    stream->dtype = header.dtype;
+  }
+
+  rewind_point_stream(stream);
+}
+
+void rewind_point_stream(point_stream_t* stream) {
+  stream->in.clear();
+  stream->in.seekg(0);
+
+  if (stream->binary) {
+    binary_header_t header;
+    stream->in.read((char *)&header, sizeof(header));
+    stream->n_points = (int)header.n;
+  }
+  else if (!(stream->in >> stream->n_points) || stream->n_points <= 0) {
+    std::cerr << stream->path << ": no number of points" << std::endl;
+    exit(1);
+  }
+  stream->next = 0;
+}
+
+void seek_point_stream(point_stream_t* stream, int index) {
+  if (stream->binary) {
+    // no need to reread the header, the points are at fixed offsets
+    stream->in.clear();
+    stream->in.seekg(sizeof(binary_header_t) + (long)index * stream->d * stream->dtype);
+  }
+  else {
+    rewind_point_stream(stream);
+    // the rest of the first line, then a line per point
+    stream->in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    for (int i = 0; i < index; i++) {
+      stream->in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+  }
+  stream->next = index;
+}
+
+// the next n lines into stream->text, parsed in chunks like read_file
+static void read_text_points(point_stream_t* stream, int n, real* points) {
+  std::string line;
+  int n_lines = 0;
+
+  stream->text.clear();
+  while (n_lines < n && std::getline(stream->in, line)) {
+    if (blank_line(line.data(), line.data() + line.size())) {
+      continue;
+    }
+    stream->text += line;
+    stream->text += '\n';
+    n_lines++;
+  }
+  if (n_lines < n) {
+    std::cerr << stream->path << ": " << stream->next + n_lines << " points, expected "
+      << stream->n_points << std::endl;
+    exit(1);
+  }
+
+  // c_str keeps the text NUL terminated for strto_real
+  const char *data = stream->text.c_str();
+  int n_threads = std::min(stream->n_threads, n);
+  parse_args_t *chunks = split_lines(data, data + stream->text.size(), n_threads);
+
+  for (int t = 0; t < n_threads; t++) {
+    chunks[t].d = stream->d;
+    chunks[t].n_points = n;
+    chunks[t].points = points;
+    chunks[t].first_index = stream->next;
+  }
+
+  run_chunks(chunks, n_threads, count_lines);
+
+  n_lines = 0;
+  for (int t = 0; t < n_threads; t++) {
+    chunks[t].first_point = n_lines;
+    n_lines += chunks[t].n_lines;
+  }
+
+  run_chunks(chunks, n_threads, parse_lines);
+
+  free(chunks);
+}
+
+static void read_binary_points(point_stream_t* stream, int n, real* points) {
+  long n_vals = (long)n * stream->d;
+
+  if (stream->dtype == sizeof(real)) {
+    stream->in.read((char *)points, n_vals * sizeof(real));
+  }
+  else {
+    for (long i = 0; i < n_vals; i++) {
+      if (stream->dtype == 4) {
+        float v;
+        stream->in.read((char *)&v, sizeof(v));
+        points[i] = v;
+      }
+      else {
+        double v;
+        stream->in.read((char *)&v, sizeof(v));
+        points[i] = v;
+      }
+    }
+  }
+
+  // the header was checked against the file size, but it can still shrink
+  if (!stream->in) {
+    std::cerr << stream->path << ": ended before point " << stream->next + n << std::endl;
+    exit(1);
+  }
+}
+
+int read_points(point_stream_t* stream, int n, real* points, bool wrap) {
+  int n_read = 0;
+
+  while (n_read < n) {
+    if (stream->next == stream->n_points) {
+      if (!wrap) {
+        break;
+      }
+      rewind_point_stream(stream);
+    }
+
+    // up to the end of the file at once
+    int n_block = std::min(n - n_read, stream->n_points - stream->next);
+    real *x = &points[(long)n_read * stream->d];
+
+    if (stream->binary) {
+      read_binary_points(stream, n_block, x);
+    }
+    else {
+      read_text_points(stream, n_block, x);
+    }
+
+    stream->next += n_block;
+    n_read += n_block;
+  }
+
+  return n_read;
 }
@@ -3,5 +3,76 @@
 #include "argparse.h"
 #include <iostream>
 #include <fstream>
+#include <string>
 
+#include <stdint.h>
+
+// Binary datasets: a binary_header_t, then n * d row-major float32 or
+// float64 values (dtype 4 or 8). read_file tells them apart from the text
+// format by the magic, and maps them in place when dtype is sizeof(real).
+#define BINARY_MAGIC "KMB1"
+
+struct binary_header_t {
+  char magic[4];
+  uint32_t dtype;
+  int64_t n;
+  int64_t d;
+  // to 64 bytes, so the payload stays aligned
+  char pad[40];
+};
+
+// Text datasets are the number of points, then one "index x_1 ... x_d" line
+// per point, parsed by args->n_threads threads.
 void read_file(struct options_t* args, int* n_vals, real** input_vals);
+// frees the points of read_file, mapped or not
+void free_points(real* points);
+void write_binary_file(const char* path, int n_points, int d, const real* points);
+
+// Sparse points in compressed rows: the nonzeros of point i are
+// cols[j], vals[j] for j in [row_start[i], row_start[i + 1]).
+struct csr_points_t {
+  int n_points;
+  int d;
+  long nnz;
+  long *row_start;
+  int *cols;
+  real *vals;
+};
+
+// Sparse text datasets are the number of points, then one
+// "index col:val col:val ..." line per point, with 0-based columns below
+// args->dimensions; parsed by args->n_threads threads like read_file.
+void read_sparse_file(struct options_t* args, csr_points_t* points);
+void free_csr_points(csr_points_t* points);
+
+// the centroids in args->centroids: the output of -c, "index x_1 ... x_d"
+// lines after the "iterations,time" line, or a binary dataset of them
+void read_centroids(struct options_t* args, int* k, real** centroids);
+// size bytes of data, as they are
+void write_raw_file(const char* path, const void* data, size_t size);
+
+// points read from args->in_file a batch at a time, for data that doesn't
+// fit in memory
+struct point_stream_t {
+  const char *path;
+  std::ifstream in;
+  // the lines of the points being read, for text files, parsed by n_threads
+  // threads
+  std::string text;
+  int n_threads;
+  int n_points;
+  int d;
+  // index of the next point to be read
+  int next;
+  bool binary;
+  uint32_t dtype;
+};
+
+void open_point_stream(struct options_t* args, point_stream_t* stream);
+// reads up to n points, wrapping around to the first point at the end of the
+// file if wrap is set; returns the number of points read
+int read_points(point_stream_t* stream, int n, real* points, bool wrap);
+void rewind_point_stream(point_stream_t* stream);
+// positions the stream at point index, for a reader of part of the file; a
+// seek for binary files, a pass over the lines before it for text files
+void seek_point_stream(point_stream_t* stream, int index);
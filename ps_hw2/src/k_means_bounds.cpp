@@ -0,0 +1,333 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include "common.h"
+#include "k_means_bounds.h"
+#include "k_means_sequential.h"
+#include "argparse.h"
+#include "phases.h"
+
+// Elkan keeps n_points * k lower bounds; above this it falls back to Hamerly
+#define ELKAN_MAX_BOUNDS (64L << 20)
+
+struct bounds_t {
+  int n_points, d, k;
+  real *points;
+  int *ids;
+
+  // upper bound on the distance to the assigned centroid
+  real *upper;
+  // Hamerly: [n_points] lower bound on the distance to any other centroid
+  // Elkan: [n_points][k] lower bound on the distance to each centroid
+  real *lower;
+  // Elkan: [k][k] half the distances between the centroids
+  real *half_cc;
+  // half the distance from each centroid to the nearest other one
+  real *half_nearest;
+  // how far each centroid moved in the last update, and the two largest
+  // moves (Hamerly)
+  real *drift;
+  int max_drift_id;
+  real max_drift, second_drift;
+
+  long n_distances;
+};
+
+// the nearest centroids are picked on the squared distances, summed like
+// the other kernels, so ties go the same way; the bounds are on distances
+static inline real distance_2(const real *x, const real *c, int d) {
+  real dist_2 = 0;
+
+  for (int l = 0; l < d; l++) {
+    dist_2 += POW2(c[l] - x[l]);
+  }
+
+  return dist_2;
+}
+
+static inline real distance(const real *x, const real *c, int d) {
+  return std::sqrt(distance_2(x, c, d));
+}
+
+static void compute_centroid_distances(bounds_t *b, const real *centroids, bool elkan) {
+  int d = b->d, k = b->k;
+
+  for (int j = 0; j < k; j++) {
+    b->half_nearest[j] = std::numeric_limits<real>::max();
+  }
+
+  for (int j = 0; j < k; j++) {
+    for (int jj = j + 1; jj < k; jj++) {
+      real half = distance(&centroids[j*d], &centroids[jj*d], d) / 2;
+
+      if (elkan) {
+        b->half_cc[(long)j*k + jj] = half;
+        b->half_cc[(long)jj*k + j] = half;
+      }
+      if (half < b->half_nearest[j]) {
+        b->half_nearest[j] = half;
+      }
+      if (half < b->half_nearest[jj]) {
+        b->half_nearest[jj] = half;
+      }
+    }
+  }
+}
+
+// nearest and second nearest centroids of point i, from scratch
+static void assign_hamerly_all(bounds_t *b, int i, const real *centroids) {
+  int d = b->d;
+  const real *x = &b->points[i*d];
+
+  int nearest_centroid = -1;
+  real nearest = std::numeric_limits<real>::max();
+  real second = std::numeric_limits<real>::max();
+
+  for (int j = 0; j < b->k; j++) {
+    real dist_2 = distance_2(x, &centroids[j*d], d);
+
+    if (dist_2 < nearest) {
+      second = nearest;
+      nearest = dist_2;
+      nearest_centroid = j;
+    }
+    else if (dist_2 < second) {
+      second = dist_2;
+    }
+  }
+  b->n_distances += b->k;
+
+  b->ids[i] = nearest_centroid;
+  b->upper[i] = std::sqrt(nearest);
+  b->lower[i] = second == std::numeric_limits<real>::max() ? second : std::sqrt(second);
+}
+
+static void assign_hamerly(bounds_t *b, const real *centroids, bool first) {
+  int d = b->d;
+
+  for (int i = 0; i < b->n_points; i++) {
+    if (!first) {
+      // move the bounds by the last update; the other centroids moved at most
+      // max_drift, or second_drift if the one that moved the most is this one
+      int a = b->ids[i];
+      b->upper[i] += b->drift[a];
+      b->lower[i] -= a == b->max_drift_id ? b->second_drift : b->max_drift;
+
+      real bound = std::max(b->half_nearest[a], b->lower[i]);
+
+      if (b->upper[i] <= bound) {
+        continue;
+      }
+
+      // tighten the upper bound, and try again
+      b->upper[i] = distance(&b->points[i*d], &centroids[b->ids[i]*d], d);
+      b->n_distances++;
+
+      if (b->upper[i] <= bound) {
+        continue;
+      }
+    }
+
+    assign_hamerly_all(b, i, centroids);
+  }
+}
+
+static void assign_elkan(bounds_t *b, const real *centroids, bool first) {
+  int d = b->d, k = b->k;
+
+  for (int i = 0; i < b->n_points; i++) {
+    const real *x = &b->points[i*d];
+    real *lower = &b->lower[(long)i*k];
+
+    if (first) {
+      int nearest_centroid = -1;
+      real nearest = std::numeric_limits<real>::max();
+
+      for (int j = 0; j < k; j++) {
+        real dist_2 = distance_2(x, &centroids[j*d], d);
+        lower[j] = std::sqrt(dist_2);
+
+        if (dist_2 < nearest) {
+          nearest = dist_2;
+          nearest_centroid = j;
+        }
+      }
+      b->n_distances += k;
+
+      b->ids[i] = nearest_centroid;
+      b->upper[i] = lower[nearest_centroid];
+      continue;
+    }
+
+    // move the bounds by the last update, while the point's bounds are in
+    // cache anyway
+    int a = b->ids[i];
+    b->upper[i] += b->drift[a];
+    for (int j = 0; j < k; j++) {
+      lower[j] = lower[j] > b->drift[j] ? lower[j] - b->drift[j] : 0;
+    }
+
+    if (b->upper[i] <= b->half_nearest[a]) {
+      continue;
+    }
+
+    bool stale = true;
+    real nearest = 0;
+    for (int j = 0; j < k; j++) {
+      if (j == a || b->upper[i] <= lower[j] || b->upper[i] <= b->half_cc[(long)a*k + j]) {
+        continue;
+      }
+
+      if (stale) {
+        nearest = distance_2(x, &centroids[a*d], d);
+        b->upper[i] = lower[a] = std::sqrt(nearest);
+        b->n_distances++;
+        stale = false;
+
+        if (b->upper[i] <= lower[j] || b->upper[i] <= b->half_cc[(long)a*k + j]) {
+          continue;
+        }
+      }
+
+      real dist_2 = distance_2(x, &centroids[j*d], d);
+      lower[j] = std::sqrt(dist_2);
+      b->n_distances++;
+
+      // ties go to the lowest index, like the full search
+      if (dist_2 < nearest || (dist_2 == nearest && j < a)) {
+        a = j;
+        nearest = dist_2;
+        b->upper[i] = lower[j];
+      }
+    }
+
+    b->ids[i] = a;
+  }
+}
+
+static void compute_drift(bounds_t *b, const real *old_centroids,
+    const real *new_centroids) {
+  b->max_drift_id = 0;
+  b->max_drift = 0;
+  b->second_drift = 0;
+
+  for (int j = 0; j < b->k; j++) {
+    b->drift[j] = distance(&old_centroids[j*b->d], &new_centroids[j*b->d], b->d);
+
+    if (b->drift[j] > b->max_drift) {
+      b->second_drift = b->max_drift;
+      b->max_drift = b->drift[j];
+      b->max_drift_id = j;
+    }
+    else if (b->drift[j] > b->second_drift) {
+      b->second_drift = b->drift[j];
+    }
+  }
+}
+
+static bool use_elkan(int n_points, struct options_t *opts) {
+  bool fits = (long)n_points * opts->n_clusters <= ELKAN_MAX_BOUNDS;
+
+  switch (opts->bounds)
+  {
+    case 1:
+      return false;
+    case 2:
+      if (!fits) {
+        std::cerr << "Too many points for Elkan bounds, using Hamerly" << std::endl;
+      }
+      return fits;
+    default:
+      // Elkan's k bounds per point pay off once there are many centroids in
+      // enough dimensions; Hamerly's single bound wins below that
+      return fits && opts->n_clusters >= 32 && opts->dimensions >= 16;
+  }
+}
+
+int k_means_bounds(int n_points, real *points, struct options_t *opts,
+    int* point_cluster_ids, real** centroids) {
+
+  int k = opts->n_clusters;
+  int d = opts->dimensions;
+  bool elkan = use_elkan(n_points, opts);
+  DEBUG_OUT(elkan ? "bounds: elkan" : "bounds: hamerly");
+
+  bounds_t b;
+  b.n_points = n_points;
+  b.d = d;
+  b.k = k;
+  b.points = points;
+  b.ids = point_cluster_ids;
+  b.upper = (real *)malloc(n_points * sizeof(real));
+  b.lower = (real *)malloc((elkan ? (long)n_points * k : n_points) * sizeof(real));
+  b.half_cc = elkan ? (real *)malloc((long)k * k * sizeof(real)) : NULL;
+  b.half_nearest = (real *)malloc(k * sizeof(real));
+  b.drift = (real *)malloc(k * sizeof(real));
+  b.n_distances = 0;
+
+  real *centroids_1 = *centroids;
+  real *centroids_2 = (real *)malloc(k * d * sizeof(real));
+  int *k_counts = (int *)malloc(k * sizeof(int));
+
+  bool done = false;
+  int iterations = 0;
+  real **old_centroids = &centroids_1;
+  real **new_centroids = &centroids_2;
+
+  while(!done) {
+    double start = phase_clock_ms();
+    compute_centroid_distances(&b, *old_centroids, elkan);
+
+    if (elkan) {
+      assign_elkan(&b, *old_centroids, iterations == 0);
+    }
+    else {
+      assign_hamerly(&b, *old_centroids, iterations == 0);
+    }
+
+    phase_times.assign_ms += phase_clock_ms() - start;
+
+    start = phase_clock_ms();
+    std::memset(k_counts, 0, sizeof(int) * k);
+    for (int i = 0; i < n_points; i++) {
+      k_counts[point_cluster_ids[i]]++;
+    }
+
+    compute_new_centroids(n_points, d, points,
+        point_cluster_ids, k, k_counts, *new_centroids);
+
+    // the bounds move by it at the start of the next assignment
+    compute_drift(&b, *old_centroids, *new_centroids);
+    phase_times.update_ms += phase_clock_ms() - start;
+
+    // swap centroids
+    *centroids = *new_centroids;
+    *new_centroids = *old_centroids;
+    *old_centroids = *centroids;
+
+    iterations++;
+    DEBUG_OUT(iterations);
+    start = phase_clock_ms();
+    done = (iterations > opts->max_iterations) ||
+      converged(k, d, opts->threshold, centroids_1, centroids_2);
+    phase_times.check_ms += phase_clock_ms() - start;
+  }
+
+  TIMING_PRINT(printf("distances: %ld of %ld (%.1fx fewer)\n", b.n_distances,
+      (long)n_points * k * iterations,
+      (double)n_points * k * iterations / b.n_distances));
+
+  DEBUG_OUT(iterations > opts->max_iterations ? "Max iterations reached!" : "Converged!" );
+
+  // release the other centroids buffer
+  free(*new_centroids);
+  free(k_counts);
+  free(b.upper);
+  free(b.lower);
+  free(b.half_cc);
+  free(b.half_nearest);
+  free(b.drift);
+
+  return iterations;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "common.h"
+#include "argparse.h"
+
+// Lloyd's k-means with triangle inequality pruning: per point upper/lower
+// bounds on the distances to the centroids, moved by how far the centroids
+// move, skip the points whose nearest centroid provably didn't change.
+//   opts->bounds: 0 = auto, 1 = Hamerly (one lower bound per point),
+//                 2 = Elkan (k lower bounds per point)
+// Same centroid updates as k_means_sequential.
+int k_means_bounds(int n_points, real *points, struct options_t *opts,
+    int* point_cluster_ids, real** centroids);
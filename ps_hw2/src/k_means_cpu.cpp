@@ -0,0 +1,356 @@
+#include <cstring>
+#include <pthread.h>
+#include "common.h"
+#include "k_means_cpu.h"
+#include "k_means_sequential.h"
+#include "k_means_kernels.h"
+#include "argparse.h"
+#include "phases.h"
+#include "seed.h"
+
+// centroid sums and point counts over a range of slices
+struct accumulator_t {
+  real *sums;
+  int *counts;
+};
+
+// subtree [lo, hi) of the slice tree that lies within one thread's slices
+struct slice_node_t {
+  int lo, hi;
+  accumulator_t acc;
+};
+
+struct k_means_cpu_args_t;
+
+struct k_means_cpu_shared_t {
+  int n_points, d, k, n_threads, n_slices;
+  real *points;
+  int *point_cluster_ids;
+  struct options_t *opts;
+  nearest_centroids_t nearest_centroids;
+
+  real *old_centroids, *new_centroids;
+  // root of the slice tree
+  accumulator_t total;
+  assign_stats_t *slice_stats;
+
+  int *slice_owners;
+  k_means_cpu_args_t *thread_args;
+  pthread_barrier_t barrier;
+
+  bool done;
+  int iterations;
+};
+
+struct k_means_cpu_args_t {
+  int t_id;
+  int slice_start, slice_end;
+  int n_nodes;
+  slice_node_t *nodes;
+  // one accumulator per tree level for the right children
+  accumulator_t *scratch;
+  k_means_cpu_shared_t *shared;
+};
+
+static accumulator_t alloc_accumulator(int k, int d) {
+  accumulator_t acc;
+  acc.sums = (real *)malloc(k * d * sizeof(real));
+  acc.counts = (int *)malloc(k * sizeof(int));
+  return acc;
+}
+
+static void free_accumulator(accumulator_t *acc) {
+  free(acc->sums);
+  free(acc->counts);
+}
+
+static int slice_point_start(int n_points, int n_slices, int slice) {
+  return (int)((long)n_points * slice / n_slices);
+}
+
+// assign the points of a slice, and sum them into acc
+static void accumulate_slice(k_means_cpu_shared_t *shared, int slice,
+    accumulator_t *acc) {
+  int d = shared->d, k = shared->k;
+  real *points = shared->points;
+  real *centroids = shared->old_centroids;
+
+  std::memset(acc->sums, 0, sizeof(real) * k * d);
+  std::memset(acc->counts, 0, sizeof(int) * k);
+
+  int start = slice_point_start(shared->n_points, shared->n_slices, slice);
+  int end = slice_point_start(shared->n_points, shared->n_slices, slice + 1);
+
+  shared->slice_stats[slice] = assign_and_accumulate(end - start, d,
+      &points[start*d], &shared->point_cluster_ids[start], k,
+      acc->counts, acc->sums, centroids, shared->nearest_centroids);
+}
+
+// sum of the slice subtree [lo, hi), always left + right
+static void compute_node(k_means_cpu_args_t *args, int lo, int hi,
+    accumulator_t *acc, int depth) {
+  k_means_cpu_shared_t *shared = args->shared;
+
+  if (hi - lo == 1) {
+    accumulate_slice(shared, lo, acc);
+    return ;
+  }
+
+  int mid = lo + (hi - lo) / 2;
+  accumulator_t *right = &args->scratch[depth];
+
+  compute_node(args, lo, mid, acc, depth + 1);
+  compute_node(args, mid, hi, right, depth + 1);
+
+  for (int i = 0; i < shared->k * shared->d; i++) {
+    acc->sums[i] += right->sums[i];
+  }
+  for (int i = 0; i < shared->k; i++) {
+    acc->counts[i] += right->counts[i];
+  }
+}
+
+// the largest subtrees of [lo, hi) within [a, b); just counts them if nodes
+// is NULL
+static void collect_nodes(int lo, int hi, int a, int b,
+    slice_node_t *nodes, int *n_nodes) {
+  if (b <= lo || hi <= a) {
+    return ;
+  }
+
+  if (a <= lo && hi <= b) {
+    if (nodes != NULL) {
+      nodes[*n_nodes].lo = lo;
+      nodes[*n_nodes].hi = hi;
+    }
+    (*n_nodes)++;
+    return ;
+  }
+
+  int mid = lo + (hi - lo) / 2;
+  collect_nodes(lo, mid, a, b, nodes, n_nodes);
+  collect_nodes(mid, hi, a, b, nodes, n_nodes);
+}
+
+// the top of the slice tree, above the per-thread subtrees, for the sums in
+// [sum_start, sum_end) and the counts in [count_start, count_end)
+static void combine_nodes(k_means_cpu_args_t *args, int lo, int hi,
+    int sum_start, int sum_end, int count_start, int count_end,
+    accumulator_t *acc, int depth) {
+  k_means_cpu_shared_t *shared = args->shared;
+  k_means_cpu_args_t *owner = &shared->thread_args[shared->slice_owners[lo]];
+
+  if (hi <= owner->slice_end) {
+    // the whole subtree was computed by its owner
+    for (int n = 0; n < owner->n_nodes; n++) {
+      slice_node_t *node = &owner->nodes[n];
+
+      if (node->lo == lo && node->hi == hi) {
+        std::memcpy(acc->sums + sum_start, node->acc.sums + sum_start,
+            (sum_end - sum_start) * sizeof(real));
+        std::memcpy(acc->counts + count_start, node->acc.counts + count_start,
+            (count_end - count_start) * sizeof(int));
+        return ;
+      }
+    }
+  }
+
+  int mid = lo + (hi - lo) / 2;
+  accumulator_t *right = &args->scratch[depth];
+
+  combine_nodes(args, lo, mid, sum_start, sum_end, count_start, count_end, acc, depth + 1);
+  combine_nodes(args, mid, hi, sum_start, sum_end, count_start, count_end, right, depth + 1);
+
+  for (int i = sum_start; i < sum_end; i++) {
+    acc->sums[i] += right->sums[i];
+  }
+  for (int i = count_start; i < count_end; i++) {
+    acc->counts[i] += right->counts[i];
+  }
+}
+
+// new centroids from the slice tree sums; on a single thread, so the
+// vanished centroids are respawned in the same k_means_rand order as
+// k_means_sequential
+static void finish_iteration(k_means_cpu_shared_t *shared) {
+  int d = shared->d, k = shared->k;
+  real *new_centroids = shared->new_centroids;
+  double start = phase_clock_ms();
+
+  // in slice order, like the sums
+  assign_stats_t stats;
+  stats.reassigned = 0;
+  stats.inertia = 0;
+  for (int s = 0; s < shared->n_slices; s++) {
+    stats.reassigned += shared->slice_stats[s].reassigned;
+    stats.inertia += shared->slice_stats[s].inertia;
+  }
+  TIMING_PRINT(printf("reassigned %d inertia %lf\n", stats.reassigned, stats.inertia));
+
+  for (int i = 0; i < k; i++) {
+    if (shared->total.counts[i] == 0) {
+      // if the centroid "vanished"
+      int index = k_means_rand() % shared->n_points;
+      std::memcpy(&new_centroids[i*d], &shared->points[index*d], d * sizeof(real));
+    }
+    else {
+      for (int l = 0; l < d; l++) {
+        new_centroids[i*d + l] = shared->total.sums[i*d + l] / shared->total.counts[i];
+      }
+    }
+  }
+
+  // swap centroids
+  real *temp_centroids = shared->new_centroids;
+  shared->new_centroids = shared->old_centroids;
+  shared->old_centroids = temp_centroids;
+  phase_times.update_ms += phase_clock_ms() - start;
+
+  shared->iterations++;
+  DEBUG_OUT(shared->iterations);
+  start = phase_clock_ms();
+  shared->done = (shared->iterations > shared->opts->max_iterations) ||
+    converged(k, d, shared->opts->threshold, shared->old_centroids, shared->new_centroids);
+  phase_times.check_ms += phase_clock_ms() - start;
+}
+
+static void *k_means_cpu_thread(void *a) {
+  k_means_cpu_args_t *args = (k_means_cpu_args_t *)a;
+  k_means_cpu_shared_t *shared = args->shared;
+
+  int n_threads = shared->n_threads;
+  int t_id = args->t_id;
+  int n_sums = shared->k * shared->d;
+
+  // columns of the sums/counts this thread adds up at the top of the tree
+  int sum_start = (int)((long)n_sums * t_id / n_threads);
+  int sum_end = (int)((long)n_sums * (t_id + 1) / n_threads);
+  int count_start = (int)((long)shared->k * t_id / n_threads);
+  int count_end = (int)((long)shared->k * (t_id + 1) / n_threads);
+
+  while (!shared->done) {
+    // the phases are timed on thread 0, between the barriers
+    double start = phase_clock_ms();
+
+    // assign + sum the thread's subtrees
+    for (int n = 0; n < args->n_nodes; n++) {
+      compute_node(args, args->nodes[n].lo, args->nodes[n].hi, &args->nodes[n].acc, 0);
+    }
+
+    pthread_barrier_wait(&shared->barrier);
+
+    combine_nodes(args, 0, shared->n_slices, sum_start, sum_end,
+        count_start, count_end, &shared->total, 0);
+
+    pthread_barrier_wait(&shared->barrier);
+
+    if (t_id == 0) {
+      phase_times.assign_ms += phase_clock_ms() - start;
+      finish_iteration(shared);
+    }
+
+    pthread_barrier_wait(&shared->barrier);
+  }
+
+  return 0;
+}
+
+int k_means_cpu(int n_points, real *points, struct options_t *opts,
+    int* point_cluster_ids, real** centroids) {
+
+  int k = opts->n_clusters;
+  int d = opts->dimensions;
+  int n_threads = opts->n_threads;
+  int n_slices = n_points < K_MEANS_CPU_SLICES ? n_points : K_MEANS_CPU_SLICES;
+
+  int tree_depth = 1;
+  while ((1 << (tree_depth - 1)) < n_slices) {
+    tree_depth++;
+  }
+
+  k_means_cpu_shared_t shared;
+  shared.n_points = n_points;
+  shared.d = d;
+  shared.k = k;
+  shared.n_threads = n_threads;
+  shared.n_slices = n_slices;
+  shared.points = points;
+  shared.point_cluster_ids = point_cluster_ids;
+  shared.opts = opts;
+  shared.nearest_centroids = select_nearest_centroids(opts->assign);
+  shared.old_centroids = *centroids;
+  shared.new_centroids = (real *)malloc(k * d * sizeof(real));
+  shared.total = alloc_accumulator(k, d);
+  shared.slice_owners = (int *)malloc(n_slices * sizeof(int));
+  shared.slice_stats = (assign_stats_t *)malloc(n_slices * sizeof(assign_stats_t));
+  shared.done = false;
+  shared.iterations = 0;
+  HANDLE(pthread_barrier_init(&shared.barrier, NULL, n_threads));
+
+  // nothing is assigned yet, every point counts as reassigned
+  for (int i = 0; i < n_points; i++) {
+    point_cluster_ids[i] = -1;
+  }
+
+  k_means_cpu_args_t *args = (k_means_cpu_args_t *)malloc(n_threads * sizeof(k_means_cpu_args_t));
+  shared.thread_args = args;
+
+  for (int t = 0; t < n_threads; t++) {
+    args[t].t_id = t;
+    args[t].shared = &shared;
+    args[t].slice_start = (int)((long)n_slices * t / n_threads);
+    args[t].slice_end = (int)((long)n_slices * (t + 1) / n_threads);
+
+    for (int s = args[t].slice_start; s < args[t].slice_end; s++) {
+      shared.slice_owners[s] = t;
+    }
+
+    args[t].n_nodes = 0;
+    collect_nodes(0, n_slices, args[t].slice_start, args[t].slice_end, NULL, &args[t].n_nodes);
+    args[t].nodes = (slice_node_t *)malloc(args[t].n_nodes * sizeof(slice_node_t));
+    args[t].n_nodes = 0;
+    collect_nodes(0, n_slices, args[t].slice_start, args[t].slice_end, args[t].nodes, &args[t].n_nodes);
+
+    for (int n = 0; n < args[t].n_nodes; n++) {
+      args[t].nodes[n].acc = alloc_accumulator(k, d);
+    }
+
+    args[t].scratch = (accumulator_t *)malloc(tree_depth * sizeof(accumulator_t));
+    for (int l = 0; l < tree_depth; l++) {
+      args[t].scratch[l] = alloc_accumulator(k, d);
+    }
+  }
+
+  pthread_t *threads = (pthread_t *)malloc(n_threads * sizeof(pthread_t));
+  for (int t = 0; t < n_threads; t++) {
+    HANDLE(pthread_create(&threads[t], NULL, k_means_cpu_thread, (void *)&args[t]));
+  }
+  for (int t = 0; t < n_threads; t++) {
+    HANDLE(pthread_join(threads[t], NULL));
+  }
+
+  DEBUG_OUT(shared.iterations > opts->max_iterations ? "Max iterations reached!" : "Converged!" );
+
+  // release the other centroids buffer
+  *centroids = shared.old_centroids;
+  free(shared.new_centroids);
+
+  for (int t = 0; t < n_threads; t++) {
+    for (int n = 0; n < args[t].n_nodes; n++) {
+      free_accumulator(&args[t].nodes[n].acc);
+    }
+    for (int l = 0; l < tree_depth; l++) {
+      free_accumulator(&args[t].scratch[l]);
+    }
+    free(args[t].nodes);
+    free(args[t].scratch);
+  }
+  free(args);
+  free(threads);
+  free(shared.slice_owners);
+  free(shared.slice_stats);
+  free_accumulator(&shared.total);
+  pthread_barrier_destroy(&shared.barrier);
+
+  return shared.iterations;
+}
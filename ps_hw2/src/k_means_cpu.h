@@ -0,0 +1,12 @@
+#pragma once
+
+#include "common.h"
+#include "argparse.h"
+
+// The points are split in K_MEANS_CPU_SLICES fixed slices, whatever the
+// thread count, and the per-slice centroid sums are always added up along the
+// same binary tree, so the results don't depend on opts->n_threads.
+#define K_MEANS_CPU_SLICES 256
+
+int k_means_cpu(int n_points, real *points, struct options_t *opts,
+    int* point_cluster_ids, real** centroids);
@@ -3,6 +3,10 @@
 #include "k_means_cuda.h"
 #include "common.h"
 
+// the host builds (make thrust_omp/thrust_tbb) compile this file as C++,
+// without the CUDA algorithms
+#ifdef __CUDACC__
+
 #include <cuda_runtime.h>
 #include "ext/helper_cuda.h"
 
@@ -394,3 +398,13 @@ int k_means_cuda(int n_points, real *points, struct options_t *opts,
 
   return iterations;
 }
+
+#else
+
+int k_means_cuda(int n_points, real *points, struct options_t *opts,
+    int* point_cluster_ids, real** centroids, double* per_iteration_time) {
+  std::cerr << "Built without CUDA, build with make" << std::endl;
+  exit(1);
+}
+
+#endif
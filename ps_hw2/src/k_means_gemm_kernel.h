@@ -0,0 +1,209 @@
+// GEMM nearest centroids kernel; no include guard, k_means_kernels.cpp
+// includes it once per instruction set, in a namespace that defines the
+// vector type gemm_vec and the register block, gemm_mr points x gemm_nr_vecs
+// vectors of centroids.
+//
+// ||x - c||^2 = ||x||^2 - 2 x.c + ||c||^2, with the x.c cross terms computed
+// as a blocked matrix product of the points and the centroids:
+//   - the centroids are packed in panels of gemm_nr, [panel][d][gemm_nr]
+//   - the points in panels of gemm_mr, [panel][d][gemm_mr], GEMM_MC at a time
+//   - the micro-kernel keeps a gemm_mr x gemm_nr tile in registers over
+//     GEMM_KC dimensions, and on the last dimension block turns it into
+//     distances and updates the running nearest centroid of its points.
+
+#ifndef GEMM_KC
+// dimensions per pass over a panel pair; a centroid panel slice stays in L1
+#define GEMM_KC 256
+// points packed at a time; the point panels stay in L2
+#define GEMM_MC 192
+// centroids per tile row; the cross terms buffer, only used when d > GEMM_KC
+#define GEMM_NC 256
+#endif
+
+static const int gemm_lanes = sizeof(gemm_vec) / sizeof(real);
+static const int gemm_nr = gemm_nr_vecs * gemm_lanes;
+
+static inline gemm_vec gemm_load(const real *x) {
+  gemm_vec v;
+  std::memcpy(&v, x, sizeof(gemm_vec));
+  return v;
+}
+
+static inline void gemm_store(real *x, gemm_vec v) {
+  std::memcpy(x, &v, sizeof(gemm_vec));
+}
+
+static inline void gemm_micro_kernel(int kc, const real *__restrict a,
+    const real *__restrict b, real *__restrict c, int ldc, bool first, bool last,
+    const real *c_norms, int centroid_start,
+    real *best, int *best_ids) {
+  gemm_vec acc[gemm_mr][gemm_nr_vecs];
+
+  for (int i = 0; i < gemm_mr; i++) {
+    for (int v = 0; v < gemm_nr_vecs; v++) {
+      acc[i][v] = first ? gemm_vec{} : gemm_load(c + i*ldc + v*gemm_lanes);
+    }
+  }
+
+  for (int l = 0; l < kc; l++) {
+    gemm_vec b_l[gemm_nr_vecs];
+    for (int v = 0; v < gemm_nr_vecs; v++) {
+      b_l[v] = gemm_load(b + l*gemm_nr + v*gemm_lanes);
+    }
+
+    for (int i = 0; i < gemm_mr; i++) {
+      real a_il = a[l*gemm_mr + i];
+      for (int v = 0; v < gemm_nr_vecs; v++) {
+        acc[i][v] += b_l[v] * a_il;
+      }
+    }
+  }
+
+  if (!last) {
+    for (int i = 0; i < gemm_mr; i++) {
+      for (int v = 0; v < gemm_nr_vecs; v++) {
+        gemm_store(c + i*ldc + v*gemm_lanes, acc[i][v]);
+      }
+    }
+    return ;
+  }
+
+  // fused arg min; ||x||^2 doesn't change the order, it's added at the end.
+  // Only rows whose minimum beats the running best look for its index.
+  gemm_vec c_norms_v[gemm_nr_vecs];
+  for (int v = 0; v < gemm_nr_vecs; v++) {
+    c_norms_v[v] = gemm_load(c_norms + v*gemm_lanes);
+  }
+
+  for (int i = 0; i < gemm_mr; i++) {
+    real dist_2[gemm_nr];
+    gemm_vec row_min_v;
+
+    for (int v = 0; v < gemm_nr_vecs; v++) {
+      gemm_vec dist_2_v = c_norms_v[v] - 2 * acc[i][v];
+      gemm_store(dist_2 + v*gemm_lanes, dist_2_v);
+      row_min_v = v == 0 ? dist_2_v : (dist_2_v < row_min_v ? dist_2_v : row_min_v);
+    }
+
+    real lanes[gemm_lanes];
+    gemm_store(lanes, row_min_v);
+    real row_min = lanes[0];
+    for (int w = 1; w < gemm_lanes; w++) {
+      row_min = lanes[w] < row_min ? lanes[w] : row_min;
+    }
+
+    if (row_min < best[i]) {
+      int j = 0;
+      while (dist_2[j] != row_min) {
+        j++;
+      }
+      best[i] = row_min;
+      best_ids[i] = centroid_start + j;
+    }
+  }
+}
+
+static int gemm_k_padded(int k) {
+  return (k + gemm_nr - 1) / gemm_nr * gemm_nr;
+}
+
+// packed_centroids is gemm_k_padded(k) * d, c_norms gemm_k_padded(k)
+static void gemm_pack_centroids(int d, int k, const real *centroids,
+    real *packed_centroids, real *c_norms) {
+  int k_padded = gemm_k_padded(k);
+
+  for (int j = 0; j < k_padded; j++) {
+    real *panel = packed_centroids + (j / gemm_nr) * d * gemm_nr + j % gemm_nr;
+    real norm = 0;
+
+    for (int l = 0; l < d; l++) {
+      real x = j < k ? centroids[j*d + l] : 0;
+      panel[l*gemm_nr] = x;
+      norm += x * x;
+    }
+
+    // padding centroids never win
+    c_norms[j] = j < k ? norm : std::numeric_limits<real>::max();
+  }
+}
+
+static void nearest_centroids_gemm_packed(int n_points, int d, const real *points,
+    int k, const real *packed_centroids, const real *c_norms, int *ids, real *dists) {
+  int k_padded = gemm_k_padded(k);
+  int nc = GEMM_NC < k_padded ? GEMM_NC : k_padded;
+
+  real *packed_points = (real *)malloc(GEMM_MC * d * sizeof(real));
+  real *x_norms = (real *)malloc(GEMM_MC * sizeof(real));
+  real *cross = d > GEMM_KC ? (real *)malloc(GEMM_MC * nc * sizeof(real)) : NULL;
+  real best[GEMM_MC];
+  int best_ids[GEMM_MC];
+
+  for (int i0 = 0; i0 < n_points; i0 += GEMM_MC) {
+    int mc = n_points - i0 < GEMM_MC ? n_points - i0 : GEMM_MC;
+    int mc_padded = (mc + gemm_mr - 1) / gemm_mr * gemm_mr;
+
+    for (int i = 0; i < mc_padded; i++) {
+      real *panel = packed_points + (i / gemm_mr) * d * gemm_mr + i % gemm_mr;
+      real norm = 0;
+
+      for (int l = 0; l < d; l++) {
+        real x = i < mc ? points[(i0 + i)*d + l] : 0;
+        panel[l*gemm_mr] = x;
+        norm += x * x;
+      }
+
+      x_norms[i] = norm;
+      best[i] = std::numeric_limits<real>::max();
+      best_ids[i] = 0;
+    }
+
+    for (int j0 = 0; j0 < k_padded; j0 += nc) {
+      int nc_block = k_padded - j0 < nc ? k_padded - j0 : nc;
+
+      for (int l0 = 0; l0 < d; l0 += GEMM_KC) {
+        int kc = d - l0 < GEMM_KC ? d - l0 : GEMM_KC;
+        bool first = l0 == 0;
+        bool last = l0 + kc == d;
+
+        for (int j = 0; j < nc_block; j += gemm_nr) {
+          const real *b = packed_centroids + (j0 + j) * d + l0 * gemm_nr;
+
+          for (int i = 0; i < mc_padded; i += gemm_mr) {
+            const real *a = packed_points + i * d + l0 * gemm_mr;
+
+            gemm_micro_kernel(kc, a, b, cross == NULL ? NULL : cross + i*nc + j, nc,
+                first, last, c_norms + j0 + j, j0 + j,
+                best + i, best_ids + i);
+          }
+        }
+      }
+    }
+
+    for (int i = 0; i < mc; i++) {
+      ids[i0 + i] = best_ids[i];
+      if (dists != NULL) {
+        // cancellation can take it slightly below 0
+        real dist_2 = x_norms[i] + best[i];
+        dists[i0 + i] = dist_2 < 0 ? 0 : dist_2;
+      }
+    }
+  }
+
+  free(packed_points);
+  free(x_norms);
+  free(cross);
+}
+
+static void nearest_centroids_gemm(int n_points, int d, const real *points,
+    int k, const real *centroids, int *ids, real *dists) {
+  int k_padded = gemm_k_padded(k);
+  real *packed_centroids = (real *)malloc(k_padded * d * sizeof(real));
+  real *c_norms = (real *)malloc(k_padded * sizeof(real));
+  gemm_pack_centroids(d, k, centroids, packed_centroids, c_norms);
+
+  nearest_centroids_gemm_packed(n_points, d, points, k, packed_centroids, c_norms,
+      ids, dists);
+
+  free(packed_centroids);
+  free(c_norms);
+}
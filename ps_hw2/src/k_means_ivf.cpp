@@ -0,0 +1,472 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <pthread.h>
+#include <vector>
+#include "common.h"
+#include "k_means_ivf.h"
+#include "k_means_sequential.h"
+#include "k_means_kernels.h"
+#include "argparse.h"
+#include "phases.h"
+#include "seed.h"
+
+// The coarse centroids and the lists are stored transposed, d x size, so the
+// distances of a point to all of them are computed a dimension at a time
+// across the centroids, which vectorizes; every distance is still summed in
+// dimension order, as in the other kernels.
+struct ivf_index_t {
+  int k, d, n_lists;
+  // n_lists x d, and d x n_lists
+  real *coarse, *coarse_t;
+  // the centroids of list j are in list_centroids from list_start[j] * d,
+  // d x (list_start[j + 1] - list_start[j]), with their indices in list_ids
+  int *list_start;
+  int *list_ids;
+  real *list_centroids;
+  // the furthest centroid of a list from its coarse centroid
+  real *radius;
+  int n_probe;
+  // coarse list of every centroid
+  int *centroid_list;
+};
+
+struct ivf_shared_t {
+  int n_points, d;
+  real *points;
+  int *point_cluster_ids;
+  // the assigned points' squared distances
+  real *dists;
+  ivf_index_t *index;
+  nearest_centroids_t nearest_centroids;
+  bool exact;
+  real *centroids;
+
+  // per slice
+  int *slice_ambiguous;
+};
+
+struct ivf_args_t {
+  ivf_shared_t *shared;
+  int slice_start, slice_end;
+  // coarse distances, and the lists in order of them
+  real *coarse_dists;
+  int *order;
+  // distances to the centroids of a list
+  real *list_dists;
+  // the ambiguous points of a slice, and a block of them
+  int *ambiguous;
+  real *block, *block_dists;
+};
+
+// squared distances of point to the size centroids of the d x size block
+static void block_dists(int d, const real *point, int size, const real *block,
+    real *dists) {
+  for (int i = 0; i < size; i++) {
+    dists[i] = 0;
+  }
+  for (int l = 0; l < d; l++) {
+    const real *row = &block[(long)l*size];
+    real x = point[l];
+    for (int i = 0; i < size; i++) {
+      dists[i] += POW2(row[i] - x);
+    }
+  }
+}
+
+// the lists around the current coarse centroids
+static void group_lists(ivf_index_t *index, real *centroids,
+    nearest_centroids_t nearest_centroids) {
+  int k = index->k, d = index->d, n_lists = index->n_lists;
+
+  nearest_centroids(k, d, centroids, n_lists, index->coarse,
+      index->centroid_list, NULL);
+
+  std::memset(index->list_start, 0, (n_lists + 1) * sizeof(int));
+  for (int c = 0; c < k; c++) {
+    index->list_start[index->centroid_list[c] + 1]++;
+  }
+  for (int j = 0; j < n_lists; j++) {
+    index->list_start[j + 1] += index->list_start[j];
+  }
+}
+
+// coarse Lloyd's over the centroids, then the lists and their radii
+static void build_index(ivf_index_t *index, real *centroids,
+    nearest_centroids_t nearest_centroids) {
+  int k = index->k, d = index->d, n_lists = index->n_lists;
+
+  for (int it = 0; it < IVF_COARSE_ITERATIONS; it++) {
+    group_lists(index, centroids, nearest_centroids);
+
+    // an empty list keeps its coarse centroid
+    for (int j = 0; j < n_lists; j++) {
+      if (index->list_start[j + 1] > index->list_start[j]) {
+        std::memset(&index->coarse[j*d], 0, d * sizeof(real));
+      }
+    }
+    for (int c = 0; c < k; c++) {
+      real *coarse = &index->coarse[index->centroid_list[c]*d];
+      for (int l = 0; l < d; l++) {
+        coarse[l] += centroids[(long)c*d + l];
+      }
+    }
+    for (int j = 0; j < n_lists; j++) {
+      int size = index->list_start[j + 1] - index->list_start[j];
+      for (int l = 0; size > 0 && l < d; l++) {
+        index->coarse[j*d + l] /= size;
+      }
+    }
+  }
+  group_lists(index, centroids, nearest_centroids);
+
+  for (int j = 0; j < n_lists; j++) {
+    for (int l = 0; l < d; l++) {
+      index->coarse_t[l*n_lists + j] = index->coarse[j*d + l];
+    }
+    index->radius[j] = 0;
+  }
+
+  // in centroid order within a list, so ties go to the lowest index
+  std::vector<int> next(index->list_start, index->list_start + n_lists);
+  for (int c = 0; c < k; c++) {
+    int j = index->centroid_list[c];
+    int start = index->list_start[j];
+    int size = index->list_start[j + 1] - start;
+    int slot = next[j]++;
+
+    index->list_ids[slot] = c;
+    real *block = &index->list_centroids[(long)start*d];
+    real dist = 0;
+    for (int l = 0; l < d; l++) {
+      block[(long)l*size + slot - start] = centroids[(long)c*d + l];
+      dist += POW2(centroids[(long)c*d + l] - index->coarse[j*d + l]);
+    }
+
+    real r = std::sqrt(dist);
+    index->radius[j] = r > index->radius[j] ? r : index->radius[j];
+  }
+}
+
+// the nearest centroid of list j to the point, if nearer than *nearest_dist
+static void scan_list(ivf_index_t *index, int j, const real *point,
+    real *list_dists, int *nearest, real *nearest_dist, real *second_dist) {
+  int start = index->list_start[j];
+  int size = index->list_start[j + 1] - start;
+
+  block_dists(index->d, point, size, &index->list_centroids[(long)start*index->d],
+      list_dists);
+
+  for (int i = 0; i < size; i++) {
+    int id = index->list_ids[start + i];
+    if (list_dists[i] < *nearest_dist ||
+        (list_dists[i] == *nearest_dist && id < *nearest)) {
+      *second_dist = *nearest_dist;
+      *nearest_dist = list_dists[i];
+      *nearest = id;
+    }
+    else if (list_dists[i] < *second_dist) {
+      *second_dist = list_dists[i];
+    }
+  }
+}
+
+// orders lists by the coarse distance, ties to the lowest list
+struct list_compare_t {
+  const real *coarse_dists;
+
+  bool operator()(int a, int b) const {
+    return coarse_dists[a] < coarse_dists[b] ||
+      (coarse_dists[a] == coarse_dists[b] && a < b);
+  }
+};
+
+// lower bounds of the squared distance of the point to the centroids of list
+// j: every centroid of j is within radius of its coarse centroid, and nearer
+// to it than to the point's nearest coarse centroid, so at least half the
+// difference of the coarse distances away
+static real radius_bound(ivf_index_t *index, int j, real coarse_dist) {
+  real gap = std::sqrt(coarse_dist) - index->radius[j];
+  return gap > 0 ? gap * gap : 0;
+}
+
+static real voronoi_bound(real coarse_dist, real nearest_coarse_dist) {
+  real gap = (std::sqrt(coarse_dist) - std::sqrt(nearest_coarse_dist)) / 2;
+  return gap * gap;
+}
+
+// the nearest centroid in the probed lists; returns true if the point is
+// ambiguous: the nearest two are within IVF_MARGIN, or, for an exact
+// assignment, an unprobed list could hold a nearer centroid
+static bool assign_point(ivf_shared_t *shared, ivf_args_t *args, const real *point,
+    int *nearest, real *nearest_dist) {
+  ivf_index_t *index = shared->index;
+  int n_lists = index->n_lists;
+  int n_probe = index->n_probe;
+  real *coarse_dists = args->coarse_dists;
+  int *order = args->order;
+
+  // the probed lists, nearest first, ties to the lowest list
+  block_dists(index->d, point, n_lists, index->coarse_t, coarse_dists);
+  for (int j = 0; j < n_lists; j++) {
+    order[j] = j;
+  }
+  list_compare_t compare;
+  compare.coarse_dists = coarse_dists;
+  std::partial_sort(order, order + n_probe, order + n_lists, compare);
+
+  *nearest = -1;
+  *nearest_dist = std::numeric_limits<real>::max();
+  real second_dist = std::numeric_limits<real>::max();
+  for (int p = 0; p < n_probe; p++) {
+    scan_list(index, order[p], point, args->list_dists, nearest, nearest_dist,
+        &second_dist);
+  }
+
+  if (second_dist <= *nearest_dist * (1 + IVF_MARGIN)) {
+    return true;
+  }
+
+  if (shared->exact) {
+    real nearest_coarse_dist = coarse_dists[order[0]];
+    for (int p = n_probe; p < n_lists; p++) {
+      int j = order[p];
+      if (voronoi_bound(coarse_dists[j], nearest_coarse_dist) <= *nearest_dist &&
+          radius_bound(index, j, coarse_dists[j]) <= *nearest_dist) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+// the ambiguous points against all the centroids, a FUSED_BLOCK at a time
+static void assign_exact(ivf_shared_t *shared, ivf_args_t *args, int n_ambiguous) {
+  int d = shared->d;
+  int ids[FUSED_BLOCK];
+
+  for (int start = 0; start < n_ambiguous; start += FUSED_BLOCK) {
+    int n_block = n_ambiguous - start < FUSED_BLOCK ? n_ambiguous - start : FUSED_BLOCK;
+    for (int i = 0; i < n_block; i++) {
+      std::memcpy(&args->block[i*d], &shared->points[(long)args->ambiguous[start + i]*d],
+          d * sizeof(real));
+    }
+
+    shared->nearest_centroids(n_block, d, args->block, shared->index->k,
+        shared->centroids, ids, args->block_dists);
+
+    for (int i = 0; i < n_block; i++) {
+      int point = args->ambiguous[start + i];
+      shared->point_cluster_ids[point] = ids[i];
+      shared->dists[point] = args->block_dists[i];
+    }
+  }
+}
+
+static void *ivf_thread(void *a) {
+  ivf_args_t *args = (ivf_args_t *)a;
+  ivf_shared_t *shared = args->shared;
+  int d = shared->d;
+
+  for (int s = args->slice_start; s < args->slice_end; s++) {
+    int start = (int)((long)shared->n_points * s / IVF_SLICES);
+    int end = (int)((long)shared->n_points * (s + 1) / IVF_SLICES);
+
+    int n_ambiguous = 0;
+    for (int i = start; i < end; i++) {
+      if (assign_point(shared, args, &shared->points[(long)i*d],
+            &shared->point_cluster_ids[i], &shared->dists[i])) {
+        args->ambiguous[n_ambiguous++] = i;
+      }
+    }
+
+    assign_exact(shared, args, n_ambiguous);
+    shared->slice_ambiguous[s] = n_ambiguous;
+  }
+
+  return 0;
+}
+
+// the smallest nprobe that has the nearest centroid of recall of the sample
+// points in the probed lists
+static int calibrate_n_probe(ivf_shared_t *shared, real *centroids,
+    real recall, real *coarse_dists) {
+  ivf_index_t *index = shared->index;
+  int n_sample = shared->n_points < IVF_SAMPLE ? shared->n_points : IVF_SAMPLE;
+  std::vector<int> ranks(n_sample);
+  list_compare_t compare;
+  compare.coarse_dists = coarse_dists;
+
+  for (int s = 0; s < n_sample; s++) {
+    const real *point = &shared->points[((long)shared->n_points * s / n_sample) * shared->d];
+
+    int nearest;
+    shared->nearest_centroids(1, shared->d, point, index->k, centroids, &nearest, NULL);
+
+    // the lists nearer than the nearest centroid's
+    block_dists(shared->d, point, index->n_lists, index->coarse_t, coarse_dists);
+    int list = index->centroid_list[nearest];
+    ranks[s] = 0;
+    for (int j = 0; j < index->n_lists; j++) {
+      ranks[s] += compare(j, list);
+    }
+  }
+
+  std::sort(ranks.begin(), ranks.end());
+  int q = (int)std::ceil(recall * n_sample) - 1;
+  q = q < 0 ? 0 : q;
+  return ranks[q] + 1;
+}
+
+int k_means_ivf(int n_points, real *points, struct options_t *opts,
+    int* point_cluster_ids, real** centroids) {
+
+  int k = opts->n_clusters;
+  int d = opts->dimensions;
+  int n_threads = opts->n_threads < IVF_SLICES ? opts->n_threads : IVF_SLICES;
+
+  real *centroids_1 = *centroids;
+  real *centroids_2 = (real *)malloc(k * d * sizeof(real));
+  int *k_counts = (int *)malloc(k * sizeof(int));
+
+  ivf_index_t index;
+  index.k = k;
+  index.d = d;
+  index.n_lists = (int)std::ceil(std::sqrt((double)k));
+  index.coarse = (real *)malloc(index.n_lists * d * sizeof(real));
+  index.coarse_t = (real *)malloc(index.n_lists * d * sizeof(real));
+  index.list_start = (int *)malloc((index.n_lists + 1) * sizeof(int));
+  index.list_ids = (int *)malloc(k * sizeof(int));
+  index.list_centroids = (real *)malloc((long)k * d * sizeof(real));
+  index.radius = (real *)malloc(index.n_lists * sizeof(real));
+  index.centroid_list = (int *)malloc(k * sizeof(int));
+  index.n_probe = 1;
+
+  // the first coarse centroids are spread over the initial centroids
+  for (int j = 0; j < index.n_lists; j++) {
+    int c = (int)((long)k * j / index.n_lists);
+    std::memcpy(&index.coarse[j*d], &centroids_1[(long)c*d], d * sizeof(real));
+  }
+
+  ivf_shared_t shared;
+  shared.n_points = n_points;
+  shared.d = d;
+  shared.points = points;
+  shared.point_cluster_ids = point_cluster_ids;
+  shared.dists = (real *)malloc(n_points * sizeof(real));
+  shared.index = &index;
+  shared.nearest_centroids = select_nearest_centroids(opts->assign);
+  shared.exact = opts->recall >= 1;
+  shared.slice_ambiguous = (int *)malloc(IVF_SLICES * sizeof(int));
+
+  ivf_args_t *args = (ivf_args_t *)malloc(n_threads * sizeof(ivf_args_t));
+  pthread_t *threads = (pthread_t *)malloc(n_threads * sizeof(pthread_t));
+  for (int t = 0; t < n_threads; t++) {
+    args[t].shared = &shared;
+    args[t].slice_start = IVF_SLICES * t / n_threads;
+    args[t].slice_end = IVF_SLICES * (t + 1) / n_threads;
+    args[t].coarse_dists = (real *)malloc(index.n_lists * sizeof(real));
+    args[t].order = (int *)malloc(index.n_lists * sizeof(int));
+    // a list can hold all the centroids
+    args[t].list_dists = (real *)malloc(k * sizeof(real));
+    args[t].ambiguous = (int *)malloc((n_points / IVF_SLICES + 1) * sizeof(int));
+    args[t].block = (real *)malloc(FUSED_BLOCK * d * sizeof(real));
+    args[t].block_dists = (real *)malloc(FUSED_BLOCK * sizeof(real));
+  }
+
+  bool done = false;
+  int iterations = 0;
+  real **old_centroids = &centroids_1;
+  real **new_centroids = &centroids_2;
+
+  while(!done) {
+    // assign includes building the index and calibrating the probes
+    double start = phase_clock_ms();
+    build_index(&index, *old_centroids, shared.nearest_centroids);
+    shared.centroids = *old_centroids;
+    // an exact assignment checks the unprobed lists of every point anyway
+    index.n_probe = shared.exact ? 1 : calibrate_n_probe(&shared, *old_centroids, opts->recall,
+          args[0].coarse_dists);
+
+    if (n_threads == 1) {
+      ivf_thread(&args[0]);
+    }
+    else {
+      for (int t = 0; t < n_threads; t++) {
+        HANDLE(pthread_create(&threads[t], NULL, ivf_thread, (void *)&args[t]));
+      }
+      for (int t = 0; t < n_threads; t++) {
+        HANDLE(pthread_join(threads[t], NULL));
+      }
+    }
+
+    phase_times.assign_ms += phase_clock_ms() - start;
+
+    int ambiguous = 0;
+    double inertia = 0;
+    for (int s = 0; s < IVF_SLICES; s++) {
+      ambiguous += shared.slice_ambiguous[s];
+    }
+    for (int i = 0; i < n_points; i++) {
+      inertia += shared.dists[i];
+    }
+    DEBUG_PRINT(printf("lists %d probed %d ambiguous %d inertia %lf\n",
+          index.n_lists, index.n_probe, ambiguous, inertia));
+    TIMING_PRINT(printf("ivf: %d of %d lists probed, %d ambiguous points\n",
+          index.n_probe, index.n_lists, ambiguous));
+
+    // in point order, like k_means_sequential
+    start = phase_clock_ms();
+    real *sums = *new_centroids;
+    std::memset(k_counts, 0, sizeof(int) * k);
+    std::memset(sums, 0, sizeof(real) * d * k);
+    for (int i = 0; i < n_points; i++) {
+      int c = point_cluster_ids[i];
+      k_counts[c]++;
+      for (int l = 0; l < d; l++) {
+        sums[(long)c*d + l] += points[(long)i*d + l];
+      }
+    }
+
+    finish_new_centroids(n_points, d, points, k, k_counts, sums);
+    phase_times.update_ms += phase_clock_ms() - start;
+
+    // swap centroids
+    *centroids = *new_centroids;
+    *new_centroids = *old_centroids;
+    *old_centroids = *centroids;
+
+    iterations++;
+    DEBUG_OUT(iterations);
+    start = phase_clock_ms();
+    done = (iterations > opts->max_iterations) ||
+      converged(k, d, opts->threshold, centroids_1, centroids_2);
+    phase_times.check_ms += phase_clock_ms() - start;
+  }
+
+  for (int t = 0; t < n_threads; t++) {
+    free(args[t].coarse_dists);
+    free(args[t].order);
+    free(args[t].list_dists);
+    free(args[t].ambiguous);
+    free(args[t].block);
+    free(args[t].block_dists);
+  }
+  free(args);
+  free(threads);
+  free(*new_centroids);
+  free(k_counts);
+  free(shared.dists);
+  free(shared.slice_ambiguous);
+  free(index.coarse);
+  free(index.list_start);
+  free(index.list_ids);
+  free(index.list_centroids);
+  free(index.radius);
+  free(index.coarse_t);
+  free(index.centroid_list);
+
+  return iterations;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "common.h"
+#include "argparse.h"
+
+// points sampled per iteration to pick the lists probed for opts->recall
+#define IVF_SAMPLE 256
+// a point whose two nearest centroids found are this close, relative to the
+// squared distance, is ambiguous
+#define IVF_MARGIN 0.05
+// Lloyd's iterations of the coarse centroids over the centroids, per build
+#define IVF_COARSE_ITERATIONS 3
+// the points are assigned in this many fixed slices, split among the threads
+#define IVF_SLICES 256
+
+// Lloyd's k-means with approximate assignment, for very large k. Every
+// iteration the centroids are clustered into about sqrt(k) lists around
+// coarse centroids (warm-started from the previous iteration's), and a point
+// is only compared against the centroids of the lists of its nprobe nearest
+// coarse centroids, so a point costs O(sqrt(k) * nprobe * d) instead of
+// O(k * d). nprobe is the smallest that finds the exact nearest centroid for
+// opts->recall of a sample of the points.
+//
+// A point is ambiguous if the two nearest centroids found are within
+// IVF_MARGIN, or, with opts->recall at 1, if an unprobed list could hold a
+// nearer centroid by the triangle inequality (with the list's radius, and
+// with the list's coarse centroid being nearer to its centroids than the
+// point's nearest coarse centroid). The ambiguous points are assigned
+// exactly, against all the centroids with the opts->assign kernel, so with
+// opts->recall at 1 the assignment is exact.
+int k_means_ivf(int n_points, real *points, struct options_t *opts,
+    int* point_cluster_ids, real** centroids);
@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include "common.h"
+#include "k_means_kdtree.h"
+#include "k_means_sequential.h"
+#include "argparse.h"
+#include "phases.h"
+
+// points per leaf
+#define KD_LEAF_SIZE 8
+
+struct kd_node_t {
+  // points index[start, end)
+  int start, end;
+  // children, -1 for a leaf
+  int left, right;
+};
+
+struct kd_tree_t {
+  int n_points, d;
+  real *points;
+  int *index;
+
+  int n_nodes, depth;
+  kd_node_t *nodes;
+  // per node: bounding box [lo, hi], sum of the points (d each) and count
+  real *lo, *hi, *sums;
+  int *counts;
+};
+
+// the filtering state of one iteration
+struct kd_filter_t {
+  kd_tree_t *tree;
+  int k;
+  const real *centroids;
+  // new centroid sums and counts
+  real *sums;
+  int *counts;
+  // point_cluster_ids to write, or NULL
+  int *labels;
+  // k candidates per tree level
+  int *candidates;
+};
+
+static inline real distance_2(const real *x, const real *c, int d) {
+  real dist_2 = 0;
+
+  for (int l = 0; l < d; l++) {
+    dist_2 += POW2(c[l] - x[l]);
+  }
+
+  return dist_2;
+}
+
+struct kd_compare_t {
+  const real *points;
+  int d, dim;
+
+  bool operator()(int a, int b) const {
+    return points[a*d + dim] < points[b*d + dim];
+  }
+};
+
+static int build_node(kd_tree_t *tree, int start, int end, int depth) {
+  int d = tree->d;
+  int node = tree->n_nodes++;
+  real *lo = &tree->lo[node*d], *hi = &tree->hi[node*d], *sum = &tree->sums[node*d];
+
+  tree->nodes[node].start = start;
+  tree->nodes[node].end = end;
+  tree->counts[node] = end - start;
+  tree->depth = std::max(tree->depth, depth);
+
+  for (int l = 0; l < d; l++) {
+    lo[l] = std::numeric_limits<real>::max();
+    hi[l] = -std::numeric_limits<real>::max();
+    sum[l] = 0;
+  }
+  for (int i = start; i < end; i++) {
+    const real *x = &tree->points[tree->index[i]*d];
+
+    for (int l = 0; l < d; l++) {
+      lo[l] = std::min(lo[l], x[l]);
+      hi[l] = std::max(hi[l], x[l]);
+      sum[l] += x[l];
+    }
+  }
+
+  if (end - start <= KD_LEAF_SIZE) {
+    tree->nodes[node].left = -1;
+    tree->nodes[node].right = -1;
+    return node;
+  }
+
+  // split the widest dimension at the median
+  kd_compare_t compare;
+  compare.points = tree->points;
+  compare.d = d;
+  compare.dim = 0;
+  for (int l = 1; l < d; l++) {
+    if (hi[l] - lo[l] > hi[compare.dim] - lo[compare.dim]) {
+      compare.dim = l;
+    }
+  }
+
+  int mid = start + (end - start) / 2;
+  std::nth_element(tree->index + start, tree->index + mid, tree->index + end, compare);
+
+  int left = build_node(tree, start, mid, depth + 1);
+  int right = build_node(tree, mid, end, depth + 1);
+  tree->nodes[node].left = left;
+  tree->nodes[node].right = right;
+
+  return node;
+}
+
+static void build_tree(kd_tree_t *tree, int n_points, int d, real *points) {
+  tree->n_points = n_points;
+  tree->d = d;
+  tree->points = points;
+  tree->index = (int *)malloc(n_points * sizeof(int));
+  for (int i = 0; i < n_points; i++) {
+    tree->index[i] = i;
+  }
+
+  // leaves hold between KD_LEAF_SIZE / 2 and KD_LEAF_SIZE points
+  int max_nodes = 2 * (n_points / (KD_LEAF_SIZE / 2) + 1);
+  tree->nodes = (kd_node_t *)malloc(max_nodes * sizeof(kd_node_t));
+  tree->lo = (real *)malloc(max_nodes * d * sizeof(real));
+  tree->hi = (real *)malloc(max_nodes * d * sizeof(real));
+  tree->sums = (real *)malloc(max_nodes * d * sizeof(real));
+  tree->counts = (int *)malloc(max_nodes * sizeof(int));
+  tree->n_nodes = 0;
+  tree->depth = 0;
+
+  build_node(tree, 0, n_points, 0);
+}
+
+static void free_tree(kd_tree_t *tree) {
+  free(tree->index);
+  free(tree->nodes);
+  free(tree->lo);
+  free(tree->hi);
+  free(tree->sums);
+  free(tree->counts);
+}
+
+// all of node's points go to centroid c
+static void assign_node(kd_filter_t *f, int node, int c) {
+  kd_tree_t *tree = f->tree;
+  int d = tree->d;
+
+  f->counts[c] += tree->counts[node];
+  for (int l = 0; l < d; l++) {
+    f->sums[c*d + l] += tree->sums[node*d + l];
+  }
+
+  if (f->labels != NULL) {
+    for (int i = tree->nodes[node].start; i < tree->nodes[node].end; i++) {
+      f->labels[tree->index[i]] = c;
+    }
+  }
+}
+
+static void filter_leaf(kd_filter_t *f, int node, const int *candidates,
+    int n_candidates) {
+  kd_tree_t *tree = f->tree;
+  int d = tree->d;
+
+  for (int i = tree->nodes[node].start; i < tree->nodes[node].end; i++) {
+    int p = tree->index[i];
+    const real *x = &tree->points[p*d];
+
+    // candidates are in index order, so ties go to the lowest one
+    int nearest_centroid = candidates[0];
+    real nearest_dist = distance_2(x, &f->centroids[candidates[0]*d], d);
+    for (int j = 1; j < n_candidates; j++) {
+      real dist_2 = distance_2(x, &f->centroids[candidates[j]*d], d);
+
+      if (dist_2 < nearest_dist) {
+        nearest_dist = dist_2;
+        nearest_centroid = candidates[j];
+      }
+    }
+
+    f->counts[nearest_centroid]++;
+    for (int l = 0; l < d; l++) {
+      f->sums[nearest_centroid*d + l] += x[l];
+    }
+    if (f->labels != NULL) {
+      f->labels[p] = nearest_centroid;
+    }
+  }
+}
+
+static void filter_node(kd_filter_t *f, int node, const int *candidates,
+    int n_candidates, int depth) {
+  kd_tree_t *tree = f->tree;
+  int d = tree->d;
+  const real *lo = &tree->lo[node*d], *hi = &tree->hi[node*d];
+
+  if (n_candidates == 1) {
+    assign_node(f, node, candidates[0]);
+    return ;
+  }
+
+  if (tree->nodes[node].left == -1) {
+    filter_leaf(f, node, candidates, n_candidates);
+    return ;
+  }
+
+  // the candidate nearest the middle of the cell
+  int best = candidates[0];
+  real best_dist = std::numeric_limits<real>::max();
+  for (int j = 0; j < n_candidates; j++) {
+    const real *z = &f->centroids[candidates[j]*d];
+    real dist_2 = 0;
+
+    for (int l = 0; l < d; l++) {
+      dist_2 += POW2(z[l] - (lo[l] + hi[l]) / 2);
+    }
+    if (dist_2 < best_dist) {
+      best_dist = dist_2;
+      best = candidates[j];
+    }
+  }
+
+  // drop the candidates that are no nearer than best anywhere in the cell:
+  // to the corner furthest towards them
+  const real *z_best = &f->centroids[best*d];
+  int *kept = &f->candidates[(depth + 1) * f->k];
+  int n_kept = 0;
+
+  for (int j = 0; j < n_candidates; j++) {
+    int c = candidates[j];
+
+    if (c != best) {
+      const real *z = &f->centroids[c*d];
+      real dist_z = 0, dist_best = 0;
+
+      for (int l = 0; l < d; l++) {
+        real v = z[l] > z_best[l] ? hi[l] : lo[l];
+        dist_z += POW2(z[l] - v);
+        dist_best += POW2(z_best[l] - v);
+      }
+
+      // ties at the corner go to the lower index, like the full search
+      if (dist_z > dist_best || (dist_z == dist_best && c > best)) {
+        continue;
+      }
+    }
+
+    kept[n_kept++] = c;
+  }
+
+  if (n_kept == 1) {
+    assign_node(f, node, kept[0]);
+    return ;
+  }
+
+  filter_node(f, tree->nodes[node].left, kept, n_kept, depth + 1);
+  filter_node(f, tree->nodes[node].right, kept, n_kept, depth + 1);
+}
+
+// sums and counts of the points nearest to each of the centroids
+static void filter(kd_filter_t *f, const real *centroids, real *sums,
+    int *counts, int *labels) {
+  int k = f->k, d = f->tree->d;
+
+  f->centroids = centroids;
+  f->sums = sums;
+  f->counts = counts;
+  f->labels = labels;
+
+  std::memset(sums, 0, sizeof(real) * k * d);
+  std::memset(counts, 0, sizeof(int) * k);
+
+  for (int j = 0; j < k; j++) {
+    f->candidates[j] = j;
+  }
+  filter_node(f, 0, f->candidates, k, 0);
+}
+
+int k_means_kdtree(int n_points, real *points, struct options_t *opts,
+    int* point_cluster_ids, real** centroids) {
+
+  int k = opts->n_clusters;
+  int d = opts->dimensions;
+
+  kd_tree_t tree;
+  build_tree(&tree, n_points, d, points);
+  DEBUG_OUT(tree.n_nodes);
+
+  kd_filter_t f;
+  f.tree = &tree;
+  f.k = k;
+  f.candidates = (int *)malloc((tree.depth + 2) * k * sizeof(int));
+
+  real *centroids_1 = *centroids;
+  real *centroids_2 = (real *)malloc(k * d * sizeof(real));
+  int *k_counts = (int *)malloc(k * sizeof(int));
+
+  bool done = false;
+  int iterations = 0;
+  real **old_centroids = &centroids_1;
+  real **new_centroids = &centroids_2;
+
+  while(!done) {
+    // the filtering assigns the points and sums them
+    double start = phase_clock_ms();
+    filter(&f, *old_centroids, *new_centroids, k_counts, NULL);
+    phase_times.assign_ms += phase_clock_ms() - start;
+
+    start = phase_clock_ms();
+    finish_new_centroids(n_points, d, points, k, k_counts, *new_centroids);
+    phase_times.update_ms += phase_clock_ms() - start;
+
+    // swap centroids
+    *centroids = *new_centroids;
+    *new_centroids = *old_centroids;
+    *old_centroids = *centroids;
+
+    iterations++;
+    DEBUG_OUT(iterations);
+    start = phase_clock_ms();
+    done = (iterations > opts->max_iterations) ||
+      converged(k, d, opts->threshold, centroids_1, centroids_2);
+    phase_times.check_ms += phase_clock_ms() - start;
+  }
+
+  DEBUG_OUT(iterations > opts->max_iterations ? "Max iterations reached!" : "Converged!" );
+
+  // the points only get their ids once, from the centroids of the last
+  // iteration, like the other algorithms report them
+  real *sums = (real *)malloc(k * d * sizeof(real));
+  filter(&f, *new_centroids, sums, k_counts, point_cluster_ids);
+  free(sums);
+
+  // release the other centroids buffer
+  free(*new_centroids);
+  free(k_counts);
+  free(f.candidates);
+  free_tree(&tree);
+
+  return iterations;
+}
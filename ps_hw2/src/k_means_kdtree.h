@@ -0,0 +1,12 @@
+#pragma once
+
+#include "common.h"
+#include "argparse.h"
+
+// Lloyd's k-means with the filtering algorithm of Kanungo et al.: a kd-tree
+// over the points, with the sum and count of every cell, is built once, and
+// every iteration walks it with a shrinking list of candidate centroids. A
+// cell whose candidates filter down to one is added to that centroid whole,
+// without visiting its points. Best for low d (up to ~16) and large n.
+int k_means_kdtree(int n_points, real *points, struct options_t *opts,
+    int* point_cluster_ids, real** centroids);
@@ -0,0 +1,370 @@
+#include <limits>
+#include <cstring>
+#include "k_means_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define K_MEANS_X86 1
+#else
+#define K_MEANS_X86 0
+#endif
+
+void nearest_centroids_scalar(int n_points, int d, const real *points,
+    int k, const real *centroids, int *ids, real *dists) {
+  for (int i = 0; i < n_points; i++) {
+    int nearest_centroid = -1;
+    real nearest_centroid_dist = std::numeric_limits<real>::max();
+
+    for (int j = 0; j < k; j++) {
+      real dist_2 = 0;
+
+      for (int l = 0; l < d; l++) {
+        dist_2 += POW2(centroids[j*d + l] - points[i*d + l]);
+      }
+
+      if (nearest_centroid_dist > dist_2) {
+        nearest_centroid_dist = dist_2;
+        nearest_centroid = j;
+      }
+    }
+
+    ids[i] = nearest_centroid;
+    if (dists != NULL) {
+      dists[i] = nearest_centroid_dist;
+    }
+  }
+}
+
+#if K_MEANS_X86
+
+// The SIMD kernel is written once in k_means_simd_kernel.h against the ops
+// wrappers below, and compiled once per instruction set: the pragmas give
+// every function in each namespace its target, and blend picks b where the
+// mask (what lt returns) is set.
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+namespace avx2 {
+#ifdef REAL_FLOAT
+struct ops {
+  typedef __m256 vec;
+  typedef __m256 mask;
+  static const int width = 8;
+  static inline vec set1(real x) { return _mm256_set1_ps(x); }
+  static inline vec loadu(const real *x) { return _mm256_loadu_ps(x); }
+  static inline void storeu(real *x, vec a) { _mm256_storeu_ps(x, a); }
+  static inline vec add(vec a, vec b) { return _mm256_add_ps(a, b); }
+  static inline vec sub(vec a, vec b) { return _mm256_sub_ps(a, b); }
+  static inline vec mul(vec a, vec b) { return _mm256_mul_ps(a, b); }
+  static inline mask lt(vec a, vec b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+  static inline vec blend(mask m, vec a, vec b) { return _mm256_blendv_ps(a, b, m); }
+};
+#else
+struct ops {
+  typedef __m256d vec;
+  typedef __m256d mask;
+  static const int width = 4;
+  static inline vec set1(real x) { return _mm256_set1_pd(x); }
+  static inline vec loadu(const real *x) { return _mm256_loadu_pd(x); }
+  static inline void storeu(real *x, vec a) { _mm256_storeu_pd(x, a); }
+  static inline vec add(vec a, vec b) { return _mm256_add_pd(a, b); }
+  static inline vec sub(vec a, vec b) { return _mm256_sub_pd(a, b); }
+  static inline vec mul(vec a, vec b) { return _mm256_mul_pd(a, b); }
+  static inline mask lt(vec a, vec b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+  static inline vec blend(mask m, vec a, vec b) { return _mm256_blendv_pd(a, b, m); }
+};
+#endif
+
+#include "k_means_simd_kernel.h"
+}
+
+void nearest_centroids_avx2(int n_points, int d, const real *points,
+    int k, const real *centroids, int *ids, real *dists) {
+  avx2::nearest_centroids_simd(n_points, d, points, k, centroids, ids, dists);
+}
+
+static void nearest_packed_avx2(const packed_centroids_t *packed, int n_points,
+    const real *points, int *ids, real *dists) {
+  avx2::nearest_centroids_simd_transposed(n_points, packed->d, points,
+      packed->k, packed->packed, ids, dists);
+}
+
+static void pack_avx2(packed_centroids_t *packed) {
+  packed->packed = (real *)malloc(packed->d * avx2::simd_k_padded(packed->k) * sizeof(real));
+  avx2::simd_transpose_centroids(packed->d, packed->k, packed->centroids, packed->packed);
+  packed->nearest = nearest_packed_avx2;
+}
+#pragma GCC pop_options
+
+// explicit rounding on mul and add, so the compiler can't contract them into
+// an FMA (the masked forms, since GCC 12 warns on the undefined source of
+// the unmasked ones)
+#define ROUND_NEAREST (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+namespace avx512 {
+#ifdef REAL_FLOAT
+struct ops {
+  typedef __m512 vec;
+  typedef __mmask16 mask;
+  static const int width = 16;
+  static inline vec set1(real x) { return _mm512_set1_ps(x); }
+  static inline vec loadu(const real *x) { return _mm512_loadu_ps(x); }
+  static inline void storeu(real *x, vec a) { _mm512_storeu_ps(x, a); }
+  static inline vec add(vec a, vec b) { return _mm512_mask_add_round_ps(a, (mask)-1, a, b, ROUND_NEAREST); }
+  static inline vec sub(vec a, vec b) { return _mm512_sub_ps(a, b); }
+  static inline vec mul(vec a, vec b) { return _mm512_mask_mul_round_ps(a, (mask)-1, a, b, ROUND_NEAREST); }
+  static inline mask lt(vec a, vec b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+  static inline vec blend(mask m, vec a, vec b) { return _mm512_mask_blend_ps(m, a, b); }
+};
+#else
+struct ops {
+  typedef __m512d vec;
+  typedef __mmask8 mask;
+  static const int width = 8;
+  static inline vec set1(real x) { return _mm512_set1_pd(x); }
+  static inline vec loadu(const real *x) { return _mm512_loadu_pd(x); }
+  static inline void storeu(real *x, vec a) { _mm512_storeu_pd(x, a); }
+  static inline vec add(vec a, vec b) { return _mm512_mask_add_round_pd(a, (mask)-1, a, b, ROUND_NEAREST); }
+  static inline vec sub(vec a, vec b) { return _mm512_sub_pd(a, b); }
+  static inline vec mul(vec a, vec b) { return _mm512_mask_mul_round_pd(a, (mask)-1, a, b, ROUND_NEAREST); }
+  static inline mask lt(vec a, vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+  static inline vec blend(mask m, vec a, vec b) { return _mm512_mask_blend_pd(m, a, b); }
+};
+#endif
+
+#include "k_means_simd_kernel.h"
+}
+
+void nearest_centroids_avx512(int n_points, int d, const real *points,
+    int k, const real *centroids, int *ids, real *dists) {
+  avx512::nearest_centroids_simd(n_points, d, points, k, centroids, ids, dists);
+}
+
+static void nearest_packed_avx512(const packed_centroids_t *packed, int n_points,
+    const real *points, int *ids, real *dists) {
+  avx512::nearest_centroids_simd_transposed(n_points, packed->d, points,
+      packed->k, packed->packed, ids, dists);
+}
+
+static void pack_avx512(packed_centroids_t *packed) {
+  packed->packed = (real *)malloc(packed->d * avx512::simd_k_padded(packed->k) * sizeof(real));
+  avx512::simd_transpose_centroids(packed->d, packed->k, packed->centroids, packed->packed);
+  packed->nearest = nearest_packed_avx512;
+}
+#pragma GCC pop_options
+
+// The GEMM kernel is plain C++ (k_means_gemm_kernel.h); the register block
+// is sized for the vector registers of each target, and the compiler
+// vectorizes the micro-kernel. Unlike the kernels above it may use FMA.
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+namespace avx2_gemm {
+// 12 of the 16 ymm registers accumulate
+typedef real gemm_vec __attribute__((vector_size(32)));
+static const int gemm_mr = 6;
+static const int gemm_nr_vecs = 2;
+
+#include "k_means_gemm_kernel.h"
+}
+
+static void nearest_centroids_gemm_avx2(int n_points, int d, const real *points,
+    int k, const real *centroids, int *ids, real *dists) {
+  avx2_gemm::nearest_centroids_gemm(n_points, d, points, k, centroids, ids, dists);
+}
+
+static void nearest_packed_gemm_avx2(const packed_centroids_t *packed, int n_points,
+    const real *points, int *ids, real *dists) {
+  avx2_gemm::nearest_centroids_gemm_packed(n_points, packed->d, points, packed->k,
+      packed->packed, packed->norms, ids, dists);
+}
+
+static void pack_gemm_avx2(packed_centroids_t *packed) {
+  int k_padded = avx2_gemm::gemm_k_padded(packed->k);
+  packed->packed = (real *)malloc(k_padded * packed->d * sizeof(real));
+  packed->norms = (real *)malloc(k_padded * sizeof(real));
+  avx2_gemm::gemm_pack_centroids(packed->d, packed->k, packed->centroids,
+      packed->packed, packed->norms);
+  packed->nearest = nearest_packed_gemm_avx2;
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,fma")
+namespace avx512_gemm {
+// 24 of the 32 zmm registers accumulate
+typedef real gemm_vec __attribute__((vector_size(64)));
+static const int gemm_mr = 12;
+static const int gemm_nr_vecs = 2;
+
+#include "k_means_gemm_kernel.h"
+}
+
+static void nearest_centroids_gemm_avx512(int n_points, int d, const real *points,
+    int k, const real *centroids, int *ids, real *dists) {
+  avx512_gemm::nearest_centroids_gemm(n_points, d, points, k, centroids, ids, dists);
+}
+
+static void nearest_packed_gemm_avx512(const packed_centroids_t *packed, int n_points,
+    const real *points, int *ids, real *dists) {
+  avx512_gemm::nearest_centroids_gemm_packed(n_points, packed->d, points, packed->k,
+      packed->packed, packed->norms, ids, dists);
+}
+
+static void pack_gemm_avx512(packed_centroids_t *packed) {
+  int k_padded = avx512_gemm::gemm_k_padded(packed->k);
+  packed->packed = (real *)malloc(k_padded * packed->d * sizeof(real));
+  packed->norms = (real *)malloc(k_padded * sizeof(real));
+  avx512_gemm::gemm_pack_centroids(packed->d, packed->k, packed->centroids,
+      packed->packed, packed->norms);
+  packed->nearest = nearest_packed_gemm_avx512;
+}
+#pragma GCC pop_options
+
+#endif
+
+namespace generic_gemm {
+typedef real gemm_vec __attribute__((vector_size(16)));
+static const int gemm_mr = 4;
+static const int gemm_nr_vecs = 2;
+
+#include "k_means_gemm_kernel.h"
+}
+
+void nearest_centroids_gemm(int n_points, int d, const real *points,
+    int k, const real *centroids, int *ids, real *dists) {
+  generic_gemm::nearest_centroids_gemm(n_points, d, points, k, centroids, ids, dists);
+}
+
+static void nearest_packed_gemm(const packed_centroids_t *packed, int n_points,
+    const real *points, int *ids, real *dists) {
+  generic_gemm::nearest_centroids_gemm_packed(n_points, packed->d, points, packed->k,
+      packed->packed, packed->norms, ids, dists);
+}
+
+static void pack_gemm(packed_centroids_t *packed) {
+  int k_padded = generic_gemm::gemm_k_padded(packed->k);
+  packed->packed = (real *)malloc(k_padded * packed->d * sizeof(real));
+  packed->norms = (real *)malloc(k_padded * sizeof(real));
+  generic_gemm::gemm_pack_centroids(packed->d, packed->k, packed->centroids,
+      packed->packed, packed->norms);
+  packed->nearest = nearest_packed_gemm;
+}
+
+static nearest_centroids_t select_gemm() {
+#if K_MEANS_X86
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("fma")) {
+    DEBUG_OUT("nearest centroids: gemm avx512");
+    return nearest_centroids_gemm_avx512;
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    DEBUG_OUT("nearest centroids: gemm avx2");
+    return nearest_centroids_gemm_avx2;
+  }
+#endif
+
+  DEBUG_OUT("nearest centroids: gemm");
+  return nearest_centroids_gemm;
+}
+
+#if K_MEANS_X86
+
+static nearest_centroids_t select_direct() {
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx512f")) {
+    DEBUG_OUT("nearest centroids: avx512");
+    return nearest_centroids_avx512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    DEBUG_OUT("nearest centroids: avx2");
+    return nearest_centroids_avx2;
+  }
+
+  DEBUG_OUT("nearest centroids: scalar");
+  return nearest_centroids_scalar;
+}
+
+#else
+
+void nearest_centroids_avx2(int n_points, int d, const real *points,
+    int k, const real *centroids, int *ids, real *dists) {
+  nearest_centroids_scalar(n_points, d, points, k, centroids, ids, dists);
+}
+
+void nearest_centroids_avx512(int n_points, int d, const real *points,
+    int k, const real *centroids, int *ids, real *dists) {
+  nearest_centroids_scalar(n_points, d, points, k, centroids, ids, dists);
+}
+
+static nearest_centroids_t select_direct() {
+  return nearest_centroids_scalar;
+}
+
+#endif
+
+nearest_centroids_t select_nearest_centroids(int assign) {
+  switch (assign)
+  {
+    case 1:
+      DEBUG_OUT("nearest centroids: scalar");
+      return nearest_centroids_scalar;
+    case 2:
+      return select_gemm();
+    default:
+      return select_direct();
+  }
+}
+
+static void nearest_packed_scalar(const packed_centroids_t *packed, int n_points,
+    const real *points, int *ids, real *dists) {
+  nearest_centroids_scalar(n_points, packed->d, points, packed->k,
+      packed->centroids, ids, dists);
+}
+
+// the layout of the kernel select_nearest_centroids picks
+void pack_centroids(packed_centroids_t *packed, int k, int d,
+    const real *centroids, int assign) {
+  nearest_centroids_t kernel = select_nearest_centroids(assign);
+
+  packed->k = k;
+  packed->d = d;
+  packed->centroids = centroids;
+  packed->packed = NULL;
+  packed->norms = NULL;
+  packed->nearest = nearest_packed_scalar;
+
+#if K_MEANS_X86
+  if (kernel == nearest_centroids_avx2) {
+    pack_avx2(packed);
+  }
+  else if (kernel == nearest_centroids_avx512) {
+    pack_avx512(packed);
+  }
+  else if (kernel == nearest_centroids_gemm_avx2) {
+    pack_gemm_avx2(packed);
+  }
+  else if (kernel == nearest_centroids_gemm_avx512) {
+    pack_gemm_avx512(packed);
+  }
+#endif
+  if (kernel == nearest_centroids_gemm) {
+    pack_gemm(packed);
+  }
+}
+
+void free_packed_centroids(packed_centroids_t *packed) {
+  free(packed->packed);
+  free(packed->norms);
+  packed->packed = NULL;
+  packed->norms = NULL;
+}
+
+void nearest_packed_centroids(const packed_centroids_t *packed, int n_points,
+    const real *points, int *ids, real *dists) {
+  packed->nearest(packed, n_points, points, ids, dists);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "common.h"
+
+// Assigns each of the n_points row-major points to its nearest centroid.
+// Writes the centroid index to ids and, if dists isn't NULL, the squared
+// distance to it. Ties go to the lowest centroid index.
+typedef void (*nearest_centroids_t)(int n_points, int d, const real *points,
+    int k, const real *centroids, int *ids, real *dists);
+
+void nearest_centroids_scalar(int n_points, int d, const real *points,
+    int k, const real *centroids, int *ids, real *dists);
+
+// AVX2 / AVX-512 kernels, several centroids per instruction and 4 points per
+// centroid load; same operation order as the scalar kernel (no FMA), so they
+// pick the same centroids
+void nearest_centroids_avx2(int n_points, int d, const real *points,
+    int k, const real *centroids, int *ids, real *dists);
+void nearest_centroids_avx512(int n_points, int d, const real *points,
+    int k, const real *centroids, int *ids, real *dists);
+
+// ||x||^2 - 2 x.c + ||c||^2 with the cross terms as a cache-blocked matrix
+// product; much faster for large k and d, but the expansion rounds
+// differently, so near ties can go to another centroid
+void nearest_centroids_gemm(int n_points, int d, const real *points,
+    int k, const real *centroids, int *ids, real *dists);
+
+// the kernel for opts->assign, in the fastest version the CPU supports:
+//   0 = direct (SIMD), 1 = scalar, 2 = gemm
+nearest_centroids_t select_nearest_centroids(int assign);
+
+// Centroids laid out once for the kernel of an assign option, to assign many
+// batches of points to the same centroids (see k_means_predict): the SIMD
+// kernels' transposed [d][k_padded] block, the GEMM kernel's panels and
+// norms. The results are the same as the kernel's on the raw centroids.
+struct packed_centroids_t {
+  int k, d;
+  // row-major, not copied; what the scalar kernel reads
+  const real *centroids;
+  // the kernel's layout and centroid norms, NULL if it has none
+  real *packed;
+  real *norms;
+  void (*nearest)(const packed_centroids_t *packed, int n_points,
+      const real *points, int *ids, real *dists);
+};
+
+void pack_centroids(packed_centroids_t *packed, int k, int d,
+    const real *centroids, int assign);
+
+void free_packed_centroids(packed_centroids_t *packed);
+
+// like a nearest_centroids_t, to the packed centroids
+void nearest_packed_centroids(const packed_centroids_t *packed, int n_points,
+    const real *points, int *ids, real *dists);
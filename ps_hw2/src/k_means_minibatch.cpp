@@ -0,0 +1,175 @@
+#include <cstring>
+#include "common.h"
+#include "k_means_minibatch.h"
+#include "k_means_sequential.h"
+#include "k_means_kernels.h"
+#include "argparse.h"
+#include "io.h"
+#include "phases.h"
+#include "seed.h"
+
+// k_means_rand only has 15 bits, not enough to index large inputs; one draw
+// per statement, the operands of | are unsequenced
+static long rand_index(long n) {
+  long r = k_means_rand();
+  r = (r << 15) | k_means_rand();
+  r = (r << 15) | k_means_rand();
+  return r % n;
+}
+
+// assign the batch, then move each centroid towards its points
+static void minibatch_step(int n_batch, int d, const real *batch_points,
+    int k, real *centroids, int *counts, int *batch_ids,
+    nearest_centroids_t nearest_centroids) {
+
+  double start = phase_clock_ms();
+  nearest_centroids(n_batch, d, batch_points, k, centroids, batch_ids, NULL);
+  phase_times.assign_ms += phase_clock_ms() - start;
+
+  start = phase_clock_ms();
+  for (int i = 0; i < n_batch; i++) {
+    int c = batch_ids[i];
+    counts[c]++;
+    real eta = (real)1 / counts[c];
+
+    for (int l = 0; l < d; l++) {
+      centroids[c*d + l] += eta * (batch_points[i*d + l] - centroids[c*d + l]);
+    }
+  }
+  phase_times.update_ms += phase_clock_ms() - start;
+}
+
+int k_means_minibatch(int n_points, real *points, struct options_t *opts,
+    int* point_cluster_ids, real** centroids) {
+
+  int k = opts->n_clusters;
+  int d = opts->dimensions;
+  int n_batch = opts->batch_size < n_points ? opts->batch_size : n_points;
+  nearest_centroids_t nearest_centroids = select_nearest_centroids(opts->assign);
+
+  real *batch_points = (real *)malloc(n_batch * d * sizeof(real));
+  int *batch_ids = (int *)malloc(n_batch * sizeof(int));
+  int *counts = (int *)calloc(k, sizeof(int));
+  real *old_centroids = (real *)malloc(k * d * sizeof(real));
+
+  bool done = false;
+  int iterations = 0;
+
+  while(!done) {
+    std::memcpy(old_centroids, *centroids, k * d * sizeof(real));
+
+    for (int i = 0; i < n_batch; i++) {
+      long index = rand_index(n_points);
+      std::memcpy(&batch_points[i*d], &points[index*d], d * sizeof(real));
+    }
+
+    minibatch_step(n_batch, d, batch_points, k, *centroids, counts, batch_ids,
+        nearest_centroids);
+
+    iterations++;
+    DEBUG_OUT(iterations);
+    double start = phase_clock_ms();
+    done = (iterations > opts->max_iterations) ||
+      converged(k, d, opts->threshold, old_centroids, *centroids);
+    phase_times.check_ms += phase_clock_ms() - start;
+  }
+
+  DEBUG_OUT(iterations > opts->max_iterations ? "Max iterations reached!" : "Converged!" );
+
+  nearest_centroids(n_points, d, points, k, *centroids, point_cluster_ids, NULL);
+
+  free(batch_points);
+  free(batch_ids);
+  free(counts);
+  free(old_centroids);
+
+  return iterations;
+}
+
+// point index of a binary stream, wherever the stream was
+static void read_point_at(point_stream_t *stream, long index, real *point) {
+  seek_point_stream(stream, (int)index);
+  read_points(stream, 1, point, false);
+}
+
+int k_means_minibatch_stream(struct options_t *opts, int *n_points,
+    int** point_cluster_ids, real* centroids) {
+
+  int k = opts->n_clusters;
+  int d = opts->dimensions;
+  nearest_centroids_t nearest_centroids = select_nearest_centroids(opts->assign);
+
+  point_stream_t stream;
+  open_point_stream(opts, &stream);
+  *n_points = stream.n_points;
+
+  int n_batch = opts->batch_size < *n_points ? opts->batch_size : *n_points;
+  real *batch_points = (real *)malloc(n_batch * d * sizeof(real));
+  int *batch_ids = (int *)malloc(n_batch * sizeof(int));
+  int *counts = (int *)calloc(k, sizeof(int));
+  real *old_centroids = (real *)malloc(k * d * sizeof(real));
+
+  // binary files are sampled like the points in memory, with the same draws
+  // and a seek per point, so they give the centroids of k_means_minibatch;
+  // text files can't seek to a point, so they are seeded from the first batch
+  // and read in consecutive batches, which is biased if the file is sorted
+  k_means_srand(opts->seed);
+  if (stream.binary) {
+    for (int i = 0; i < k; i++) {
+      read_point_at(&stream, k_means_rand() % *n_points, &centroids[i*d]);
+    }
+  }
+  else {
+    read_points(&stream, n_batch, batch_points, true);
+    for (int i = 0; i < k; i++) {
+      long index = rand_index(n_batch);
+      std::memcpy(&centroids[i*d], &batch_points[index*d], d * sizeof(real));
+    }
+  }
+
+  bool done = false;
+  int iterations = 0;
+
+  while(!done) {
+    if (stream.binary) {
+      for (int i = 0; i < n_batch; i++) {
+        read_point_at(&stream, rand_index(*n_points), &batch_points[i*d]);
+      }
+    }
+    else if (iterations > 0) {
+      read_points(&stream, n_batch, batch_points, true);
+    }
+
+    std::memcpy(old_centroids, centroids, k * d * sizeof(real));
+
+    minibatch_step(n_batch, d, batch_points, k, centroids, counts, batch_ids,
+        nearest_centroids);
+
+    iterations++;
+    DEBUG_OUT(iterations);
+    double start = phase_clock_ms();
+    done = (iterations > opts->max_iterations) ||
+      converged(k, d, opts->threshold, old_centroids, centroids);
+    phase_times.check_ms += phase_clock_ms() - start;
+  }
+
+  DEBUG_OUT(iterations > opts->max_iterations ? "Max iterations reached!" : "Converged!" );
+
+  // assign all the points, a batch at a time
+  *point_cluster_ids = (int *)malloc(*n_points * sizeof(int));
+  rewind_point_stream(&stream);
+
+  int n_read, start = 0;
+  while ((n_read = read_points(&stream, n_batch, batch_points, false)) > 0) {
+    nearest_centroids(n_read, d, batch_points, k, centroids,
+        *point_cluster_ids + start, NULL);
+    start += n_read;
+  }
+
+  free(batch_points);
+  free(batch_ids);
+  free(counts);
+  free(old_centroids);
+
+  return iterations;
+}
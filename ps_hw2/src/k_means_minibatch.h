@@ -0,0 +1,21 @@
+#pragma once
+
+#include "common.h"
+#include "argparse.h"
+
+// Mini-batch k-means: every iteration assigns opts->batch_size points
+// sampled with k_means_rand, and moves each centroid towards its points with
+// a per-centroid learning rate of 1 / (points it has seen so far). Stops
+// when an iteration moves the centroids less than opts->threshold.
+int k_means_minibatch(int n_points, real *points, struct options_t *opts,
+    int* point_cluster_ids, real** centroids);
+
+// Same, with the points streamed from opts->in_file instead of read_file'd,
+// and seeded like k_means_init_random_centroids. Binary files are sampled
+// with a seek per point, giving the same centroids as k_means_minibatch;
+// text files are seeded from the first batch and read in consecutive
+// batches wrapping around at the end of the file, which is biased if the
+// file is sorted, so convert them with -x first. The points are assigned in
+// a final pass over the file; sets n_points and allocates point_cluster_ids.
+int k_means_minibatch_stream(struct options_t *opts, int *n_points,
+    int** point_cluster_ids, real* centroids);
@@ -0,0 +1,233 @@
+#include "k_means_mpi.h"
+
+#ifdef K_MEANS_MPI
+
+#include <cstring>
+#include <mpi.h>
+#include "k_means_sequential.h"
+#include "k_means_kernels.h"
+#include "io.h"
+#include "seed.h"
+
+#ifdef REAL_FLOAT
+#define MPI_REAL_T MPI_FLOAT
+#else
+#define MPI_REAL_T MPI_DOUBLE
+#endif
+
+// the points at indices, from the ranks that hold them, on every rank
+static void gather_points(int n, const long *indices, long start, long end,
+    int d, const real *local_points, real *points) {
+  for (int i = 0; i < n; i++) {
+    if (indices[i] >= start && indices[i] < end) {
+      std::memcpy(&points[i*d], &local_points[(indices[i] - start) * d], d * sizeof(real));
+    }
+    else {
+      std::memset(&points[i*d], 0, d * sizeof(real));
+    }
+  }
+
+  MPI_Allreduce(MPI_IN_PLACE, points, n * d, MPI_REAL_T, MPI_SUM, MPI_COMM_WORLD);
+}
+
+int k_means_mpi(struct options_t *opts, int *n_points,
+    int** point_cluster_ids, real* centroids) {
+
+  int initialized;
+  MPI_Initialized(&initialized);
+  if (!initialized) {
+    MPI_Init(NULL, NULL);
+  }
+
+  int world_size;
+  MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+
+  int world_rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+
+  int k = opts->n_clusters;
+  int d = opts->dimensions;
+  nearest_centroids_t nearest_centroids = select_nearest_centroids(opts->assign);
+
+  // static partitioning, every rank reads its own points
+  point_stream_t stream;
+  open_point_stream(opts, &stream);
+  *n_points = stream.n_points;
+
+  long start = (long)*n_points * world_rank / world_size;
+  long end = (long)*n_points * (world_rank + 1) / world_size;
+  int n_local = (int)(end - start);
+
+  double read_timing = MPI_Wtime();
+  real *local_points = (real *)malloc((long)n_local * d * sizeof(real));
+  seek_point_stream(&stream, (int)start);
+  read_points(&stream, n_local, local_points, false);
+  read_timing = MPI_Wtime() - read_timing;
+
+  // the same points as k_means_init_random_centroids
+  long *indices = (long *)malloc(k * sizeof(long));
+  k_means_srand(opts->seed);
+  for (int i = 0; i < k; i++) {
+    indices[i] = k_means_rand() % *n_points;
+  }
+  gather_points(k, indices, start, end, d, local_points, centroids);
+
+  int *local_ids = (int *)malloc(n_local * sizeof(int));
+  for (int i = 0; i < n_local; i++) {
+    local_ids[i] = -1;
+  }
+
+  real *old_centroids = centroids;
+  real *new_centroids = (real *)malloc(k * d * sizeof(real));
+  real *respawned = (real *)malloc(k * d * sizeof(real));
+  int *k_counts = (int *)malloc(k * sizeof(int));
+
+  double compute_timing = 0.0f,
+         allreduce_timing = 0.0f;
+
+  bool done = false;
+  int iterations = 0;
+
+  while(!done) {
+    double iteration_start_time = MPI_Wtime();
+
+    std::memset(new_centroids, 0, sizeof(real) * k * d);
+    std::memset(k_counts, 0, sizeof(int) * k);
+    assign_stats_t stats = assign_and_accumulate(n_local, d, local_points,
+        local_ids, k, k_counts, new_centroids, old_centroids, nearest_centroids);
+
+    compute_timing += MPI_Wtime() - iteration_start_time;
+
+    iteration_start_time = MPI_Wtime();
+    MPI_Allreduce(MPI_IN_PLACE, new_centroids, k * d, MPI_REAL_T, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, k_counts, k, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    allreduce_timing += MPI_Wtime() - iteration_start_time;
+
+    if (DEBUG_TEST) {
+      MPI_Allreduce(MPI_IN_PLACE, &stats.reassigned, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+      MPI_Allreduce(MPI_IN_PLACE, &stats.inertia, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    }
+    TIMING_PRINT(printf("P%d reassigned %d inertia %lf\n", world_rank, stats.reassigned, stats.inertia));
+
+    // the counts are the same on every rank, and so are the respawned points:
+    // the ones k_means_sequential would pick
+    int n_vanished = 0;
+    for (int i = 0; i < k; i++) {
+      if (k_counts[i] == 0) {
+        indices[n_vanished++] = k_means_rand() % *n_points;
+      }
+      else {
+        for (int l = 0; l < d; l++) {
+          new_centroids[i*d + l] /= k_counts[i];
+        }
+      }
+    }
+    if (n_vanished > 0) {
+      gather_points(n_vanished, indices, start, end, d, local_points, respawned);
+
+      for (int i = 0, j = 0; i < k; i++) {
+        if (k_counts[i] == 0) {
+          std::memcpy(&new_centroids[i*d], &respawned[(j++)*d], d * sizeof(real));
+        }
+      }
+    }
+
+    // swap centroids
+    real *temp_centroids = new_centroids;
+    new_centroids = old_centroids;
+    old_centroids = temp_centroids;
+
+    iterations++;
+    DEBUG_OUT(iterations);
+
+    // decided together, so no rank is left waiting in an allreduce
+    int local_done = (iterations > opts->max_iterations) ||
+      converged(k, d, opts->threshold, old_centroids, new_centroids);
+    int all_done;
+    MPI_Allreduce(&local_done, &all_done, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    done = all_done;
+  }
+
+  DEBUG_OUT(iterations > opts->max_iterations ? "Max iterations reached!" : "Converged!" );
+
+  // the centroids are the caller's buffer
+  if (old_centroids != centroids) {
+    std::memcpy(centroids, old_centroids, k * d * sizeof(real));
+    free(old_centroids);
+  }
+  else {
+    free(new_centroids);
+  }
+
+  if (!opts->print_centroids) {
+    int *partition_sizes = (int *)malloc(world_size * sizeof(int));
+    int *partition_starts = (int *)malloc(world_size * sizeof(int));
+
+    for (int r = 0; r < world_size; r++) {
+      partition_starts[r] = (int)((long)*n_points * r / world_size);
+      partition_sizes[r] = (int)((long)*n_points * (r + 1) / world_size) - partition_starts[r];
+    }
+
+    if (world_rank == 0) {
+      *point_cluster_ids = (int *)malloc(*n_points * sizeof(int));
+    }
+    MPI_Gatherv(local_ids, n_local, MPI_INT, *point_cluster_ids,
+        partition_sizes, partition_starts, MPI_INT, 0, MPI_COMM_WORLD);
+
+    free(partition_sizes);
+    free(partition_starts);
+  }
+
+  TIMING_PRINT(printf("P%d read: %lf\n", world_rank, read_timing * 1000));
+  TIMING_PRINT(printf("P%d compute: %lf\n", world_rank,
+        (compute_timing / iterations) * 1000));
+  TIMING_PRINT(printf("P%d allreduce: %lf\n", world_rank,
+        (allreduce_timing / iterations) * 1000));
+
+  free(local_points);
+  free(local_ids);
+  free(indices);
+  free(respawned);
+  free(k_counts);
+
+  return iterations;
+}
+
+bool k_means_mpi_root() {
+  int initialized;
+  MPI_Initialized(&initialized);
+  if (!initialized) {
+    return true;
+  }
+
+  int world_rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+  return world_rank == 0;
+}
+
+void k_means_mpi_finalize() {
+  int initialized, finalized;
+  MPI_Initialized(&initialized);
+  MPI_Finalized(&finalized);
+
+  if (initialized && !finalized) {
+    MPI_Finalize();
+  }
+}
+
+#else
+
+int k_means_mpi(struct options_t *opts, int *n_points,
+    int** point_cluster_ids, real* centroids) {
+  std::cerr << "Built without MPI, build with make mpi" << std::endl;
+  exit(1);
+}
+
+bool k_means_mpi_root() {
+  return true;
+}
+
+void k_means_mpi_finalize() {
+}
+
+#endif
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "common.h"
+#include "argparse.h"
+
+// Lloyd's k-means over MPI ranks, built with `make mpi` (-DK_MEANS_MPI) and
+// run with mpiexec: every rank reads its own contiguous slice of
+// opts->in_file, assigns and sums it with the CPU kernel, and the sums and
+// counts are combined with MPI_Allreduce each iteration, so every rank
+// computes the same centroids. The centroids are seeded at the same random
+// points as k_means_init_random_centroids. Sets n_points, and allocates
+// point_cluster_ids on the root rank unless only the centroids are printed.
+int k_means_mpi(struct options_t *opts, int *n_points,
+    int** point_cluster_ids, real* centroids);
+
+// whether this is the rank that prints the results; always true without MPI
+bool k_means_mpi_root();
+
+void k_means_mpi_finalize();
@@ -0,0 +1,320 @@
+#include <algorithm>
+#include <cstring>
+#include <pthread.h>
+#include <stdint.h>
+#include <vector>
+#include "common.h"
+#include "k_means_outofcore.h"
+#include "k_means_sequential.h"
+#include "k_means_kernels.h"
+#include "argparse.h"
+#include "io.h"
+#include "seed.h"
+
+// the assignments of the whole file, 1, 2 or 4 bytes each
+struct packed_ids_t {
+  void *ids;
+  int width;
+};
+
+struct out_of_core_t {
+  int d, k, n_threads;
+  long chunk_start;
+  int n_chunk;
+  real *chunk;
+  // the chunk's assignments, unpacked
+  int *chunk_ids;
+  packed_ids_t packed;
+
+  real *centroids;
+  nearest_centroids_t nearest_centroids;
+
+  // per slice sums, counts and stats
+  real *slice_sums;
+  int *slice_counts;
+  assign_stats_t *slice_stats;
+};
+
+struct out_of_core_args_t {
+  int slice_start, slice_end;
+  out_of_core_t *shared;
+};
+
+struct read_ahead_t {
+  point_stream_t *stream;
+  int n;
+  real *points;
+  int n_read;
+};
+
+static packed_ids_t alloc_packed_ids(int n_points, int k) {
+  packed_ids_t packed;
+  // the largest value of the width stands for "not assigned yet"
+  packed.width = k < 0xFF ? 1 : k < 0xFFFF ? 2 : 4;
+  packed.ids = malloc((long)n_points * packed.width);
+  std::memset(packed.ids, 0xFF, (long)n_points * packed.width);
+  return packed;
+}
+
+static void unpack_ids(const packed_ids_t *packed, long start, int n, int *ids) {
+  for (int i = 0; i < n; i++) {
+    switch (packed->width)
+    {
+      case 1: {
+        uint8_t id = ((uint8_t *)packed->ids)[start + i];
+        ids[i] = id == 0xFF ? -1 : id;
+        break;
+      }
+      case 2: {
+        uint16_t id = ((uint16_t *)packed->ids)[start + i];
+        ids[i] = id == 0xFFFF ? -1 : id;
+        break;
+      }
+      default:
+        ids[i] = ((int32_t *)packed->ids)[start + i];
+    }
+  }
+}
+
+static void pack_ids(packed_ids_t *packed, long start, int n, const int *ids) {
+  for (int i = 0; i < n; i++) {
+    switch (packed->width)
+    {
+      case 1:
+        ((uint8_t *)packed->ids)[start + i] = (uint8_t)ids[i];
+        break;
+      case 2:
+        ((uint16_t *)packed->ids)[start + i] = (uint16_t)ids[i];
+        break;
+      default:
+        ((int32_t *)packed->ids)[start + i] = ids[i];
+    }
+  }
+}
+
+static int slice_point_start(int n_points, int slice) {
+  return (int)((long)n_points * slice / OUT_OF_CORE_SLICES);
+}
+
+// assign and sum the thread's slices of the chunk
+static void *assign_slices(void *a) {
+  out_of_core_args_t *args = (out_of_core_args_t *)a;
+  out_of_core_t *shared = args->shared;
+  int d = shared->d, k = shared->k;
+
+  for (int s = args->slice_start; s < args->slice_end; s++) {
+    int start = slice_point_start(shared->n_chunk, s);
+    int end = slice_point_start(shared->n_chunk, s + 1);
+    real *sums = &shared->slice_sums[(long)s * k * d];
+    int *counts = &shared->slice_counts[s * k];
+    int *ids = &shared->chunk_ids[start];
+
+    std::memset(sums, 0, sizeof(real) * k * d);
+    std::memset(counts, 0, sizeof(int) * k);
+
+    unpack_ids(&shared->packed, shared->chunk_start + start, end - start, ids);
+    shared->slice_stats[s] = assign_and_accumulate(end - start, d,
+        &shared->chunk[(long)start * d], ids, k, counts, sums,
+        shared->centroids, shared->nearest_centroids);
+    pack_ids(&shared->packed, shared->chunk_start + start, end - start, ids);
+  }
+
+  return 0;
+}
+
+static void *read_ahead(void *a) {
+  read_ahead_t *args = (read_ahead_t *)a;
+  args->n_read = read_points(args->stream, args->n, args->points, false);
+  return 0;
+}
+
+// the points at indices, in that order, in one pass over the file
+static void gather_points(point_stream_t *stream, int n_buffer, real *buffer,
+    int n, const long *indices, real *points) {
+  int d = stream->d;
+  std::vector<std::pair<long, int> > order(n);
+  for (int i = 0; i < n; i++) {
+    order[i] = std::make_pair(indices[i], i);
+  }
+  std::sort(order.begin(), order.end());
+
+  rewind_point_stream(stream);
+
+  long base = 0;
+  int next = 0, n_read;
+  while (next < n && (n_read = read_points(stream, n_buffer, buffer, false)) > 0) {
+    for (; next < n && order[next].first < base + n_read; next++) {
+      std::memcpy(&points[(long)order[next].second * d],
+          &buffer[(order[next].first - base) * d], d * sizeof(real));
+    }
+    base += n_read;
+  }
+}
+
+int k_means_outofcore(struct options_t *opts, int *n_points,
+    int** point_cluster_ids, real* centroids) {
+
+  int k = opts->n_clusters;
+  int d = opts->dimensions;
+  int n_threads = std::min(opts->n_threads, OUT_OF_CORE_SLICES);
+
+  point_stream_t stream;
+  open_point_stream(opts, &stream);
+  *n_points = stream.n_points;
+
+  int n_buffer = std::min(opts->chunk_size, *n_points);
+  real *buffers[2];
+  buffers[0] = (real *)malloc((long)n_buffer * d * sizeof(real));
+  buffers[1] = (real *)malloc((long)n_buffer * d * sizeof(real));
+
+  // the same points as k_means_init_random_centroids
+  long *indices = (long *)malloc(k * sizeof(long));
+  k_means_srand(opts->seed);
+  for (int i = 0; i < k; i++) {
+    indices[i] = k_means_rand() % *n_points;
+  }
+  gather_points(&stream, n_buffer, buffers[0], k, indices, centroids);
+
+  out_of_core_t shared;
+  shared.d = d;
+  shared.k = k;
+  shared.n_threads = n_threads;
+  shared.chunk_ids = (int *)malloc(n_buffer * sizeof(int));
+  shared.packed = alloc_packed_ids(*n_points, k);
+  shared.nearest_centroids = select_nearest_centroids(opts->assign);
+  shared.slice_sums = (real *)malloc((long)OUT_OF_CORE_SLICES * k * d * sizeof(real));
+  shared.slice_counts = (int *)malloc(OUT_OF_CORE_SLICES * k * sizeof(int));
+  shared.slice_stats = (assign_stats_t *)malloc(OUT_OF_CORE_SLICES * sizeof(assign_stats_t));
+
+  out_of_core_args_t *args = (out_of_core_args_t *)malloc(n_threads * sizeof(out_of_core_args_t));
+  for (int t = 0; t < n_threads; t++) {
+    args[t].slice_start = OUT_OF_CORE_SLICES * t / n_threads;
+    args[t].slice_end = OUT_OF_CORE_SLICES * (t + 1) / n_threads;
+    args[t].shared = &shared;
+  }
+  pthread_t *threads = (pthread_t *)malloc(n_threads * sizeof(pthread_t));
+
+  real *old_centroids = centroids;
+  real *new_centroids = (real *)malloc(k * d * sizeof(real));
+  int *k_counts = (int *)malloc(k * sizeof(int));
+
+  bool done = false;
+  int iterations = 0;
+
+  while(!done) {
+    std::memset(new_centroids, 0, sizeof(real) * k * d);
+    std::memset(k_counts, 0, sizeof(int) * k);
+    shared.centroids = old_centroids;
+
+    assign_stats_t stats;
+    stats.reassigned = 0;
+    stats.inertia = 0;
+
+    rewind_point_stream(&stream);
+    int b = 0;
+    int n_read = read_points(&stream, n_buffer, buffers[b], false);
+    long chunk_start = 0;
+
+    while (n_read > 0) {
+      // read the next chunk while this one is assigned
+      pthread_t reader;
+      read_ahead_t next;
+      next.stream = &stream;
+      next.n = n_buffer;
+      next.points = buffers[1 - b];
+      HANDLE(pthread_create(&reader, NULL, read_ahead, (void *)&next));
+
+      shared.chunk_start = chunk_start;
+      shared.n_chunk = n_read;
+      shared.chunk = buffers[b];
+      for (int t = 0; t < n_threads; t++) {
+        HANDLE(pthread_create(&threads[t], NULL, assign_slices, (void *)&args[t]));
+      }
+      for (int t = 0; t < n_threads; t++) {
+        HANDLE(pthread_join(threads[t], NULL));
+      }
+
+      for (int s = 0; s < OUT_OF_CORE_SLICES; s++) {
+        for (int i = 0; i < k * d; i++) {
+          new_centroids[i] += shared.slice_sums[(long)s * k * d + i];
+        }
+        for (int i = 0; i < k; i++) {
+          k_counts[i] += shared.slice_counts[s * k + i];
+        }
+        stats.reassigned += shared.slice_stats[s].reassigned;
+        stats.inertia += shared.slice_stats[s].inertia;
+      }
+
+      HANDLE(pthread_join(reader, NULL));
+      chunk_start += n_read;
+      n_read = next.n_read;
+      b = 1 - b;
+    }
+    TIMING_PRINT(printf("reassigned %d inertia %lf\n", stats.reassigned, stats.inertia));
+
+    // vanished centroids are respawned on the points k_means_sequential
+    // would pick, fetched from the file
+    int n_vanished = 0;
+    for (int i = 0; i < k; i++) {
+      if (k_counts[i] == 0) {
+        indices[n_vanished++] = k_means_rand() % *n_points;
+      }
+      else {
+        for (int l = 0; l < d; l++) {
+          new_centroids[i*d + l] /= k_counts[i];
+        }
+      }
+    }
+    if (n_vanished > 0) {
+      real *respawned = (real *)malloc(n_vanished * d * sizeof(real));
+      gather_points(&stream, n_buffer, buffers[0], n_vanished, indices, respawned);
+
+      for (int i = 0, j = 0; i < k; i++) {
+        if (k_counts[i] == 0) {
+          std::memcpy(&new_centroids[i*d], &respawned[(j++)*d], d * sizeof(real));
+        }
+      }
+      free(respawned);
+    }
+
+    // swap centroids
+    real *temp_centroids = new_centroids;
+    new_centroids = old_centroids;
+    old_centroids = temp_centroids;
+
+    iterations++;
+    DEBUG_OUT(iterations);
+    done = (iterations > opts->max_iterations) ||
+      converged(k, d, opts->threshold, old_centroids, new_centroids);
+  }
+
+  DEBUG_OUT(iterations > opts->max_iterations ? "Max iterations reached!" : "Converged!" );
+
+  // the centroids are the caller's buffer
+  if (old_centroids != centroids) {
+    std::memcpy(centroids, old_centroids, k * d * sizeof(real));
+    free(old_centroids);
+  }
+  else {
+    free(new_centroids);
+  }
+
+  if (!opts->print_centroids) {
+    *point_cluster_ids = (int *)malloc(*n_points * sizeof(int));
+    unpack_ids(&shared.packed, 0, *n_points, *point_cluster_ids);
+  }
+
+  free(buffers[0]);
+  free(buffers[1]);
+  free(indices);
+  free(k_counts);
+  free(args);
+  free(threads);
+  free(shared.chunk_ids);
+  free(shared.packed.ids);
+  free(shared.slice_sums);
+  free(shared.slice_counts);
+  free(shared.slice_stats);
+
+  return iterations;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "common.h"
+#include "argparse.h"
+
+// chunk slices, assigned in parallel and summed in slice order, so the
+// results don't depend on opts->n_threads
+#define OUT_OF_CORE_SLICES 64
+
+// Lloyd's k-means over points that don't fit in memory: every iteration
+// streams opts->in_file in chunks of opts->chunk_size points, reading the
+// next chunk while opts->n_threads threads assign and sum the current one.
+// Only the centroids, the sums and the assignments, packed to the fewest
+// bytes that hold k, stay in memory. The centroids are seeded at the same
+// random points as k_means_init_random_centroids. Sets n_points, and
+// allocates point_cluster_ids unless only the centroids are printed.
+int k_means_outofcore(struct options_t *opts, int *n_points,
+    int** point_cluster_ids, real* centroids);
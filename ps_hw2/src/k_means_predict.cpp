@@ -0,0 +1,72 @@
+#include <pthread.h>
+#include "common.h"
+#include "k_means_predict.h"
+
+struct predict_args_t {
+  const k_means_model_t *model;
+  int start, end;
+  const real *points;
+  int *ids;
+  real *dists;
+};
+
+void k_means_model_init(k_means_model_t *model, int k, int d,
+    const real *centroids, int assign) {
+  model->k = k;
+  model->d = d;
+  model->centroids = centroids;
+  pack_centroids(&model->packed, k, d, centroids, assign);
+}
+
+void k_means_model_free(k_means_model_t *model) {
+  free_packed_centroids(&model->packed);
+}
+
+static void *predict_thread(void *a) {
+  predict_args_t *args = (predict_args_t *)a;
+  const k_means_model_t *model = args->model;
+  int d = model->d;
+
+  nearest_packed_centroids(&model->packed, args->end - args->start,
+      &args->points[(long)args->start*d], &args->ids[args->start],
+      args->dists == NULL ? NULL : &args->dists[args->start]);
+
+  return 0;
+}
+
+void k_means_predict(const k_means_model_t *model, int n_points,
+    const real *points, int *ids, real *dists, int n_threads) {
+  int max_threads = n_points / PREDICT_MIN_THREAD_POINTS;
+  if (n_threads > max_threads) {
+    n_threads = max_threads;
+  }
+  if (n_threads < 1) {
+    n_threads = 1;
+  }
+
+  predict_args_t *args = (predict_args_t *)malloc(n_threads * sizeof(predict_args_t));
+  for (int t = 0; t < n_threads; t++) {
+    args[t].model = model;
+    args[t].start = (int)((long)n_points * t / n_threads);
+    args[t].end = (int)((long)n_points * (t + 1) / n_threads);
+    args[t].points = points;
+    args[t].ids = ids;
+    args[t].dists = dists;
+  }
+
+  if (n_threads == 1) {
+    predict_thread(&args[0]);
+  }
+  else {
+    pthread_t *threads = (pthread_t *)malloc(n_threads * sizeof(pthread_t));
+    for (int t = 0; t < n_threads; t++) {
+      HANDLE(pthread_create(&threads[t], NULL, predict_thread, (void *)&args[t]));
+    }
+    for (int t = 0; t < n_threads; t++) {
+      HANDLE(pthread_join(threads[t], NULL));
+    }
+    free(threads);
+  }
+
+  free(args);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "common.h"
+#include "k_means_kernels.h"
+
+// below this many points per thread, k_means_predict runs on the caller's
+// thread, for low latency on small batches
+#define PREDICT_MIN_THREAD_POINTS 4096
+
+// trained centroids, for assigning new points in process
+struct k_means_model_t {
+  int k, d;
+  const real *centroids;
+  // in the kernel's layout, built once for every k_means_predict call
+  packed_centroids_t packed;
+};
+
+// the centroids aren't copied, and must outlive the model; assign picks the
+// kernel as opts->assign does
+void k_means_model_init(k_means_model_t *model, int k, int d,
+    const real *centroids, int assign);
+
+void k_means_model_free(k_means_model_t *model);
+
+// Assigns the n_points row-major points to their nearest centroids, on up to
+// n_threads threads. Writes the centroid indices to ids and, if dists isn't
+// NULL, the squared distances to them. Ties go to the lowest centroid index.
+void k_means_predict(const k_means_model_t *model, int n_points,
+    const real *points, int *ids, real *dists, int n_threads);
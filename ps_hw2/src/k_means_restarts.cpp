@@ -0,0 +1,279 @@
+#include <cstring>
+#include <limits>
+#include <pthread.h>
+#include "common.h"
+#include "k_means_restarts.h"
+#include "k_means_sequential.h"
+#include "k_means_kernels.h"
+#include "argparse.h"
+#include "seed.h"
+
+// the outcome of a run that ended before all the lower runs were decided
+struct restarts_pending_t {
+  bool ended, finished;
+  int iterations;
+  double inertia, peak_inertia;
+  int *ids;
+  real *centroids;
+};
+
+struct restarts_shared_t {
+  int n_points;
+  real *points;
+  struct options_t *opts;
+  nearest_centroids_t nearest_centroids;
+
+  pthread_mutex_t lock;
+  // guarded by lock
+  int next_run;
+  // runs [0, n_decided) are decided; best_* is the best of them
+  int n_decided;
+  restarts_pending_t *pending;
+  int best_run, best_iterations, n_abandoned;
+  double best_inertia;
+  int *best_ids;
+  real *best_centroids;
+};
+
+// the buffers of one thread's runs
+struct restarts_args_t {
+  restarts_shared_t *shared;
+  int *ids;
+  real *centroids_1, *centroids_2;
+  int *k_counts;
+};
+
+static double best_inertia(restarts_shared_t *shared) {
+  HANDLE(pthread_mutex_lock(&shared->lock));
+  double inertia = shared->best_inertia;
+  HANDLE(pthread_mutex_unlock(&shared->lock));
+  return inertia;
+}
+
+// one k_means_sequential run; false if abandoned. peak_inertia is the
+// highest inertia from RESTART_MIN_ITERATIONS on, which decides the run in
+// decide_run
+static bool run_restart(restarts_args_t *args, int run, int *iterations,
+    double *inertia, double *peak_inertia) {
+  restarts_shared_t *shared = args->shared;
+  struct options_t *opts = shared->opts;
+  int n_points = shared->n_points;
+  real *points = shared->points;
+  int k = opts->n_clusters;
+  int d = opts->dimensions;
+
+  k_means_rand_t rand_state = opts->seed + run;
+  switch (opts->init)
+  {
+    case 1:
+      k_means_init_plus_plus_r(n_points, d, points, k, args->centroids_1,
+          &rand_state, 1);
+      break;
+    case 2:
+      k_means_init_parallel_r(n_points, d, points, k, args->centroids_1,
+          &rand_state, 1);
+      break;
+    default:
+      k_means_init_random_centroids_r(n_points, d, points, k, args->centroids_1,
+          &rand_state);
+  }
+
+  // nothing is assigned yet, every point counts as reassigned
+  for (int i = 0; i < n_points; i++) {
+    args->ids[i] = -1;
+  }
+
+  bool done = false;
+  *iterations = 0;
+  *peak_inertia = 0;
+  real *old_centroids = args->centroids_1;
+  real *new_centroids = args->centroids_2;
+
+  while(!done) {
+    std::memset(args->k_counts, 0, sizeof(int) * k);
+    std::memset(new_centroids, 0, sizeof(real) * d * k);
+
+    assign_stats_t stats = assign_and_accumulate(n_points, d, points,
+        args->ids, k, args->k_counts, new_centroids, old_centroids,
+        shared->nearest_centroids);
+    *inertia = stats.inertia;
+
+    // Lloyd's inertia only goes down, but rarely by much after the first
+    // iterations. The best so far only covers decided lower runs, and is
+    // never below the one decide_run compares with, so a run stopped here
+    // would be abandoned there anyway
+    if (*iterations >= RESTART_MIN_ITERATIONS) {
+      *peak_inertia = stats.inertia > *peak_inertia ? stats.inertia : *peak_inertia;
+      if (stats.inertia > RESTART_ABANDON_RATIO * best_inertia(shared)) {
+        return false;
+      }
+    }
+
+    finish_new_centroids_r(n_points, d, points, k, args->k_counts,
+        new_centroids, &rand_state);
+
+    // swap centroids
+    real *temp_centroids = new_centroids;
+    new_centroids = old_centroids;
+    old_centroids = temp_centroids;
+
+    (*iterations)++;
+    done = (*iterations > opts->max_iterations) ||
+      converged(k, d, opts->threshold, args->centroids_1, args->centroids_2);
+  }
+
+  // the last centroids are in old_centroids
+  if (old_centroids != args->centroids_1) {
+    args->centroids_2 = args->centroids_1;
+    args->centroids_1 = old_centroids;
+  }
+
+  return true;
+}
+
+// with lock held, once every lower run is decided: a run is abandoned if its
+// peak inertia is above RESTART_ABANDON_RATIO times the best lower run's,
+// whenever it was stopped, so the outcome doesn't depend on the threads
+static void decide_run(restarts_shared_t *shared, int run, const int *ids,
+    const real *centroids) {
+  restarts_pending_t *pending = &shared->pending[run];
+  int k = shared->opts->n_clusters;
+  int d = shared->opts->dimensions;
+
+  if (!pending->finished ||
+      pending->peak_inertia > RESTART_ABANDON_RATIO * shared->best_inertia) {
+    shared->n_abandoned++;
+  }
+  // ties go to the lowest run, which was decided first
+  else if (pending->inertia < shared->best_inertia) {
+    shared->best_run = run;
+    shared->best_iterations = pending->iterations;
+    shared->best_inertia = pending->inertia;
+    std::memcpy(shared->best_ids, ids, shared->n_points * sizeof(int));
+    std::memcpy(shared->best_centroids, centroids, k * d * sizeof(real));
+  }
+}
+
+// with lock held; decides run and any higher runs that ended before it
+static void end_run(restarts_args_t *args, int run) {
+  restarts_shared_t *shared = args->shared;
+  restarts_pending_t *pending = &shared->pending[run];
+  int k = shared->opts->n_clusters;
+  int d = shared->opts->dimensions;
+
+  pending->ended = true;
+  if (run == shared->n_decided) {
+    decide_run(shared, run, args->ids, args->centroids_1);
+    shared->n_decided++;
+  }
+  else if (pending->finished) {
+    // the thread's buffers go to its next run
+    pending->ids = (int *)malloc(shared->n_points * sizeof(int));
+    pending->centroids = (real *)malloc(k * d * sizeof(real));
+    std::memcpy(pending->ids, args->ids, shared->n_points * sizeof(int));
+    std::memcpy(pending->centroids, args->centroids_1, k * d * sizeof(real));
+  }
+
+  while (shared->n_decided < shared->opts->restarts &&
+      shared->pending[shared->n_decided].ended) {
+    restarts_pending_t *next = &shared->pending[shared->n_decided];
+    decide_run(shared, shared->n_decided, next->ids, next->centroids);
+    free(next->ids);
+    free(next->centroids);
+    shared->n_decided++;
+  }
+}
+
+static void *restarts_thread(void *a) {
+  restarts_args_t *args = (restarts_args_t *)a;
+  restarts_shared_t *shared = args->shared;
+  struct options_t *opts = shared->opts;
+
+  while (true) {
+    HANDLE(pthread_mutex_lock(&shared->lock));
+    int run = shared->next_run++;
+    HANDLE(pthread_mutex_unlock(&shared->lock));
+
+    if (run >= opts->restarts) {
+      break;
+    }
+
+    int iterations;
+    double inertia, peak_inertia;
+    bool finished = run_restart(args, run, &iterations, &inertia, &peak_inertia);
+    DEBUG_PRINT(printf("run %d %s after %d iterations, inertia %lf\n", run,
+          finished ? "finished" : "stopped", iterations, inertia));
+
+    HANDLE(pthread_mutex_lock(&shared->lock));
+    restarts_pending_t *pending = &shared->pending[run];
+    pending->finished = finished;
+    pending->iterations = iterations;
+    pending->inertia = inertia;
+    pending->peak_inertia = peak_inertia;
+    end_run(args, run);
+    HANDLE(pthread_mutex_unlock(&shared->lock));
+  }
+
+  return 0;
+}
+
+int k_means_restarts(int n_points, real *points, struct options_t *opts,
+    int* point_cluster_ids, real** centroids) {
+
+  int k = opts->n_clusters;
+  int d = opts->dimensions;
+  int n_threads = opts->n_threads < opts->restarts ? opts->n_threads : opts->restarts;
+
+  restarts_shared_t shared;
+  shared.n_points = n_points;
+  shared.points = points;
+  shared.opts = opts;
+  shared.nearest_centroids = select_nearest_centroids(opts->assign);
+  shared.next_run = 0;
+  shared.n_decided = 0;
+  shared.pending = (restarts_pending_t *)malloc(opts->restarts * sizeof(restarts_pending_t));
+  for (int r = 0; r < opts->restarts; r++) {
+    shared.pending[r].ended = false;
+    shared.pending[r].ids = NULL;
+    shared.pending[r].centroids = NULL;
+  }
+  shared.best_run = -1;
+  shared.best_iterations = 0;
+  shared.n_abandoned = 0;
+  shared.best_inertia = std::numeric_limits<double>::max();
+  shared.best_ids = point_cluster_ids;
+  shared.best_centroids = *centroids;
+  HANDLE(pthread_mutex_init(&shared.lock, NULL));
+
+  restarts_args_t *args = (restarts_args_t *)malloc(n_threads * sizeof(restarts_args_t));
+  pthread_t *threads = (pthread_t *)malloc(n_threads * sizeof(pthread_t));
+
+  for (int t = 0; t < n_threads; t++) {
+    args[t].shared = &shared;
+    args[t].ids = (int *)malloc(n_points * sizeof(int));
+    args[t].centroids_1 = (real *)malloc(k * d * sizeof(real));
+    args[t].centroids_2 = (real *)malloc(k * d * sizeof(real));
+    args[t].k_counts = (int *)malloc(k * sizeof(int));
+    HANDLE(pthread_create(&threads[t], NULL, restarts_thread, (void *)&args[t]));
+  }
+  for (int t = 0; t < n_threads; t++) {
+    HANDLE(pthread_join(threads[t], NULL));
+  }
+
+  DEBUG_OUT(shared.best_run);
+  TIMING_PRINT(printf("restarts: best run %d inertia %lf, %d of %d abandoned\n",
+        shared.best_run, shared.best_inertia, shared.n_abandoned, opts->restarts));
+
+  for (int t = 0; t < n_threads; t++) {
+    free(args[t].ids);
+    free(args[t].centroids_1);
+    free(args[t].centroids_2);
+    free(args[t].k_counts);
+  }
+  free(args);
+  free(threads);
+  free(shared.pending);
+  pthread_mutex_destroy(&shared.lock);
+
+  return shared.best_iterations;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "common.h"
+#include "argparse.h"
+
+// a run is abandoned if its inertia, after this many iterations, is ever this
+// much above the best of the lower runs that weren't abandoned
+#define RESTART_MIN_ITERATIONS 5
+#define RESTART_ABANDON_RATIO 1.2
+
+// opts->restarts independent runs of k_means_sequential over the same
+// points, opts->n_threads at a time. Run r seeds with opts->seed + r, with
+// its own k_means_rand_r stream, so run 0 is the plain sequential run. Runs
+// are decided in order of r, so which runs are abandoned doesn't depend on
+// the threads. The run with the lowest inertia (ties to the lowest r) is
+// returned in point_cluster_ids and centroids, along with its iterations.
+int k_means_restarts(int n_points, real *points, struct options_t *opts,
+    int* point_cluster_ids, real** centroids);
@@ -1,56 +1,95 @@
 #include <cstring>
-#include <cfloat>
 #include "common.h"
 #include "k_means_sequential.h"
+#include "k_means_kernels.h"
 #include "argparse.h"
+#include "phases.h"
 #include "seed.h"
 
-void assign_point_cluster_ids(int n_points, int d, real *points,
-    int *point_cluster_ids, int k, int *k_counts, real *centroids) {
+assign_stats_t assign_and_accumulate(int n_points, int d, real *points,
+    int *point_cluster_ids, int k, int *k_counts, real *sums, real *centroids,
+    nearest_centroids_t nearest_centroids) {
 
-  std::memset(k_counts, 0, sizeof(int) * k);
+  assign_stats_t stats;
+  stats.reassigned = 0;
+  stats.inertia = 0;
 
-  for (int i = 0; i < n_points; i++) {
-    int nearest_centroid = -1;
-    real nearest_centroid_dist = DBL_MAX;
+  int ids[FUSED_BLOCK];
+  real dists[FUSED_BLOCK];
 
-    for (int j = 0; j < k; j++) {
-      real dist_2 = 0;
+  for (int start = 0; start < n_points; start += FUSED_BLOCK) {
+    int n_block = n_points - start < FUSED_BLOCK ? n_points - start : FUSED_BLOCK;
+    real *block = &points[start*d];
 
-      for (int l = 0; l < d; l++) {
-        dist_2 += POW2(centroids[j*d + l] - points[i*d + l]);
-      }
+    nearest_centroids(n_block, d, block, k, centroids, ids, dists);
+
+    // the block is still in cache
+    for (int i = 0; i < n_block; i++) {
+      int c = ids[i];
 
-      // if (i == 8) {
-      //   printf("p %d k %d d %f", i, j, dist_2);
-      // }
+      stats.reassigned += point_cluster_ids[start + i] != c;
+      stats.inertia += dists[i];
+      point_cluster_ids[start + i] = c;
 
-      if (nearest_centroid_dist > dist_2) {
-        nearest_centroid_dist = dist_2;
-        nearest_centroid = j;
+      k_counts[c]++;
+      for (int l = 0; l < d; l++) {
+        sums[c*d + l] += block[i*d + l];
       }
     }
-
-    point_cluster_ids[i] = nearest_centroid;
-    // DEBUG_PRINT(printf("%d %lf ", nearest_centroid, nearest_centroid_dist));
-    k_counts[nearest_centroid]++;
   }
+
+  return stats;
 }
 
-void compute_new_centroids(int n_points, int d, real *points,
-    int *point_cluster_ids, int k, int *k_counts, real *new_centroids, real *old_centroids) {
-  std::memset(new_centroids, 0, sizeof(real) * d * k);
+assign_stats_t assign_and_update(int n_points, int d, real *points,
+    int *point_cluster_ids, int k, int *k_counts, real *sums, real *centroids,
+    nearest_centroids_t nearest_centroids) {
 
-  for (int i = 0; i < n_points; i++) {
-    for (int l = 0; l < d; l++) {
-      new_centroids[point_cluster_ids[i]*d + l] += points[i*d + l];
+  assign_stats_t stats;
+  stats.reassigned = 0;
+  stats.inertia = 0;
+
+  int ids[FUSED_BLOCK];
+  real dists[FUSED_BLOCK];
+
+  for (int start = 0; start < n_points; start += FUSED_BLOCK) {
+    int n_block = n_points - start < FUSED_BLOCK ? n_points - start : FUSED_BLOCK;
+    real *block = &points[start*d];
+
+    nearest_centroids(n_block, d, block, k, centroids, ids, dists);
+
+    for (int i = 0; i < n_block; i++) {
+      int c = ids[i];
+      int old_c = point_cluster_ids[start + i];
+      stats.inertia += dists[i];
+
+      if (c == old_c) {
+        continue;
+      }
+
+      // move the point from its old cluster's sums to the new one's
+      stats.reassigned++;
+      point_cluster_ids[start + i] = c;
+
+      k_counts[old_c]--;
+      k_counts[c]++;
+      for (int l = 0; l < d; l++) {
+        sums[old_c*d + l] -= block[i*d + l];
+        sums[c*d + l] += block[i*d + l];
+      }
     }
   }
+
+  return stats;
+}
+
+void finish_new_centroids_r(int n_points, int d, real *points,
+    int k, int *k_counts, real *new_centroids, k_means_rand_t *rand_state) {
   for (int i = 0; i < k; i++) {
     if (k_counts[i] == 0) {
       // if the centroid "vanished"
       int index = 0;
-      index = k_means_rand() % n_points;
+      index = (rand_state == NULL ? k_means_rand() : k_means_rand_r(rand_state)) % n_points;
       std::memcpy(&new_centroids[i*d], &points[index*d], d * sizeof(real));
     }
     else {
@@ -61,6 +100,24 @@ void compute_new_centroids(int n_points, int d, real *points,
   }
 }
 
+void finish_new_centroids(int n_points, int d, real *points,
+    int k, int *k_counts, real *new_centroids) {
+  finish_new_centroids_r(n_points, d, points, k, k_counts, new_centroids, NULL);
+}
+
+void compute_new_centroids(int n_points, int d, real *points,
+    int *point_cluster_ids, int k, int *k_counts, real *new_centroids) {
+  std::memset(new_centroids, 0, sizeof(real) * d * k);
+
+  for (int i = 0; i < n_points; i++) {
+    for (int l = 0; l < d; l++) {
+      new_centroids[point_cluster_ids[i]*d + l] += points[i*d + l];
+    }
+  }
+
+  finish_new_centroids(n_points, d, points, k, k_counts, new_centroids);
+}
+
 bool converged(int k, int d, real t, real *centroids_1, real *centroids_2) {
   bool result = true;
 
@@ -79,6 +136,17 @@ int k_means_sequential(int n_points, real *points, struct options_t *opts,
   real *centroids_1 = *centroids;
   real *centroids_2 = (real *)malloc(opts->n_clusters * opts->dimensions * sizeof(real));
   int *k_counts = (int *)malloc(opts->n_clusters * sizeof(int));
+  nearest_centroids_t nearest_centroids = select_nearest_centroids(opts->assign);
+  int k = opts->n_clusters;
+  int d = opts->dimensions;
+
+  // running per-cluster sums, for incremental updates
+  real *sums = opts->recompute > 0 ? (real *)malloc(k * d * sizeof(real)) : NULL;
+
+  // nothing is assigned yet, every point counts as reassigned
+  for (int i = 0; i < n_points; i++) {
+    point_cluster_ids[i] = -1;
+  }
 
   bool done = false;
   int iterations = 0;
@@ -91,11 +159,40 @@ int k_means_sequential(int n_points, real *points, struct options_t *opts,
     DEBUG_PRINT(printf("Old centroids\n"));
     DEBUG_PRINT(PRINT_CENTROIDS(*old_centroids, opts->dimensions, opts->n_clusters));
 
-    assign_point_cluster_ids(n_points, opts->dimensions, points,
-        point_cluster_ids, opts->n_clusters, k_counts, *old_centroids);
+    assign_stats_t stats;
+    double start = phase_clock_ms();
+
+    if (sums == NULL) {
+      // one pass: assign and sum into the new centroids
+      std::memset(k_counts, 0, sizeof(int) * k);
+      std::memset(*new_centroids, 0, sizeof(real) * d * k);
+
+      stats = assign_and_accumulate(n_points, d, points, point_cluster_ids, k,
+          k_counts, *new_centroids, *old_centroids, nearest_centroids);
+    }
+    else {
+      // the running sums, from scratch every opts->recompute iterations to
+      // bound the rounding drift of the updates
+      if (iterations % opts->recompute == 0) {
+        std::memset(k_counts, 0, sizeof(int) * k);
+        std::memset(sums, 0, sizeof(real) * d * k);
+
+        stats = assign_and_accumulate(n_points, d, points, point_cluster_ids, k,
+            k_counts, sums, *old_centroids, nearest_centroids);
+      }
+      else {
+        stats = assign_and_update(n_points, d, points, point_cluster_ids, k,
+            k_counts, sums, *old_centroids, nearest_centroids);
+      }
+
+      std::memcpy(*new_centroids, sums, sizeof(real) * d * k);
+    }
+    phase_times.assign_ms += phase_clock_ms() - start;
+    TIMING_PRINT(printf("reassigned %d inertia %lf\n", stats.reassigned, stats.inertia));
 
-    compute_new_centroids(n_points, opts->dimensions, points,
-        point_cluster_ids, opts->n_clusters, k_counts, *new_centroids, *old_centroids);
+    start = phase_clock_ms();
+    finish_new_centroids(n_points, d, points, k, k_counts, *new_centroids);
+    phase_times.update_ms += phase_clock_ms() - start;
 
     // printf("New new_centroids\n");
     // PRINT_CENTROIDS(*new_centroids, opts->dimensions, opts->n_clusters);
@@ -107,13 +204,16 @@ int k_means_sequential(int n_points, real *points, struct options_t *opts,
 
     iterations++;
     DEBUG_OUT(iterations);
+    start = phase_clock_ms();
     done = (iterations > opts->max_iterations) ||
       converged(opts->n_clusters, opts->dimensions, opts->threshold, centroids_1, centroids_2);
+    phase_times.check_ms += phase_clock_ms() - start;
     DEBUG_OUT(done);
   }
   // release the other centroids buffer
   free(*new_centroids);
   free(k_counts);
+  free(sums);
 
   DEBUG_OUT(iterations > opts->max_iterations ? "Max iterations reached!" : "Converged!" );
 
@@ -1,6 +1,46 @@
 #pragma once
 
 #include "common.h"
+#include "k_means_kernels.h"
+#include "seed.h"
 
 int k_means_sequential(int n_points, real *points, struct options_t *opts,
     int* point_cluster_ids, real** centroids);
+
+// points assigned per nearest_centroids call, and summed while in cache
+#define FUSED_BLOCK 256
+
+struct assign_stats_t {
+  // points whose nearest centroid changed
+  int reassigned;
+  // sum of the squared distances to the nearest centroids
+  double inertia;
+};
+
+// Assigns the points to the nearest of the centroids, and adds each one to
+// its centroid's sums and k_counts in the same pass, a FUSED_BLOCK at a time.
+// point_cluster_ids holds the previous assignment, -1 for none.
+assign_stats_t assign_and_accumulate(int n_points, int d, real *points,
+    int *point_cluster_ids, int k, int *k_counts, real *sums, real *centroids,
+    nearest_centroids_t nearest_centroids);
+
+// Same, but the sums and k_counts are kept from the previous assignment in
+// point_cluster_ids, and only the points that changed cluster are moved, so
+// the update costs O(reassigned * d).
+assign_stats_t assign_and_update(int n_points, int d, real *points,
+    int *point_cluster_ids, int k, int *k_counts, real *sums, real *centroids,
+    nearest_centroids_t nearest_centroids);
+
+// sums to means; vanished centroids are respawned on a k_means_rand point
+void finish_new_centroids(int n_points, int d, real *points,
+    int k, int *k_counts, real *new_centroids);
+// same, with the points drawn from rand_state, or k_means_rand if NULL
+void finish_new_centroids_r(int n_points, int d, real *points,
+    int k, int *k_counts, real *new_centroids, k_means_rand_t *rand_state);
+
+// new centroids from the assignment; vanished centroids are respawned on a
+// k_means_rand point
+void compute_new_centroids(int n_points, int d, real *points,
+    int *point_cluster_ids, int k, int *k_counts, real *new_centroids);
+
+bool converged(int k, int d, real t, real *centroids_1, real *centroids_2);
@@ -0,0 +1,126 @@
+// SIMD nearest centroids kernel; no include guard, k_means_kernels.cpp
+// includes it once per instruction set, in a namespace that defines the ops
+// vector wrappers.
+
+// points evaluated per centroid load
+#ifndef SIMD_POINTS
+#define SIMD_POINTS 4
+#endif
+
+// Centroids are transposed to [d][k_padded], so one load gets the same
+// dimension of ops::width centroids. Each lane keeps its own running
+// minimum (and the centroid index, as a real) and the lanes are reduced at
+// the end of the point.
+template <int n_pts>
+static inline void nearest_centroids_simd_block(int d, const real *points,
+    int k, int k_padded, const real *transposed, int *ids, real *dists) {
+  typedef ops::vec vec;
+  typedef ops::mask mask;
+  const int width = ops::width;
+
+  vec best[n_pts], best_ids[n_pts];
+  for (int p = 0; p < n_pts; p++) {
+    best[p] = ops::set1(std::numeric_limits<real>::max());
+    best_ids[p] = ops::set1(0);
+  }
+
+  real lane_ids[width];
+  for (int w = 0; w < width; w++) {
+    lane_ids[w] = w;
+  }
+  vec centroid_ids = ops::loadu(lane_ids);
+  const vec id_step = ops::set1(width);
+  const vec max_dist = ops::set1(std::numeric_limits<real>::max());
+  const vec n_centroids = ops::set1(k);
+
+  for (int j = 0; j < k_padded; j += width) {
+    vec dist_2[n_pts];
+    for (int p = 0; p < n_pts; p++) {
+      dist_2[p] = ops::set1(0);
+    }
+
+    for (int l = 0; l < d; l++) {
+      vec c = ops::loadu(transposed + l*k_padded + j);
+
+      for (int p = 0; p < n_pts; p++) {
+        vec diff = ops::sub(c, ops::set1(points[p*d + l]));
+        dist_2[p] = ops::add(dist_2[p], ops::mul(diff, diff));
+      }
+    }
+
+    // padding lanes past k never win
+    mask padding = ops::lt(centroid_ids, n_centroids);
+
+    for (int p = 0; p < n_pts; p++) {
+      dist_2[p] = ops::blend(padding, max_dist, dist_2[p]);
+
+      mask nearer = ops::lt(dist_2[p], best[p]);
+      best[p] = ops::blend(nearer, best[p], dist_2[p]);
+      best_ids[p] = ops::blend(nearer, best_ids[p], centroid_ids);
+    }
+
+    centroid_ids = ops::add(centroid_ids, id_step);
+  }
+
+  for (int p = 0; p < n_pts; p++) {
+    real lane_dists[width];
+    ops::storeu(lane_dists, best[p]);
+    ops::storeu(lane_ids, best_ids[p]);
+
+    int nearest_centroid = (int)lane_ids[0];
+    real nearest_centroid_dist = lane_dists[0];
+    for (int w = 1; w < width; w++) {
+      if (lane_dists[w] < nearest_centroid_dist ||
+          (lane_dists[w] == nearest_centroid_dist && (int)lane_ids[w] < nearest_centroid)) {
+        nearest_centroid_dist = lane_dists[w];
+        nearest_centroid = (int)lane_ids[w];
+      }
+    }
+
+    ids[p] = nearest_centroid;
+    if (dists != NULL) {
+      dists[p] = nearest_centroid_dist;
+    }
+  }
+}
+
+static int simd_k_padded(int k) {
+  return (k + ops::width - 1) / ops::width * ops::width;
+}
+
+// transposed is d * simd_k_padded(k)
+static void simd_transpose_centroids(int d, int k, const real *centroids,
+    real *transposed) {
+  int k_padded = simd_k_padded(k);
+
+  for (int l = 0; l < d; l++) {
+    for (int j = 0; j < k_padded; j++) {
+      transposed[l*k_padded + j] = j < k ? centroids[j*d + l] : 0;
+    }
+  }
+}
+
+static void nearest_centroids_simd_transposed(int n_points, int d,
+    const real *points, int k, const real *transposed, int *ids, real *dists) {
+  int k_padded = simd_k_padded(k);
+
+  int i = 0;
+  for (; i + SIMD_POINTS <= n_points; i += SIMD_POINTS) {
+    nearest_centroids_simd_block<SIMD_POINTS>(d, points + i*d, k, k_padded,
+        transposed, ids + i, dists == NULL ? NULL : dists + i);
+  }
+  for (; i < n_points; i++) {
+    nearest_centroids_simd_block<1>(d, points + i*d, k, k_padded,
+        transposed, ids + i, dists == NULL ? NULL : dists + i);
+  }
+}
+
+static void nearest_centroids_simd(int n_points, int d, const real *points,
+    int k, const real *centroids, int *ids, real *dists) {
+  real *transposed = (real *)malloc(d * simd_k_padded(k) * sizeof(real));
+  simd_transpose_centroids(d, k, centroids, transposed);
+
+  nearest_centroids_simd_transposed(n_points, d, points, k, transposed, ids, dists);
+
+  free(transposed);
+}
@@ -0,0 +1,229 @@
+#include <cstring>
+#include <pthread.h>
+#include "common.h"
+#include "k_means_sparse.h"
+#include "k_means_sequential.h"
+#include "argparse.h"
+#include "seed.h"
+
+struct sparse_shared_t {
+  csr_points_t *points;
+  int k;
+  int *point_cluster_ids;
+
+  // squared norms of the points, and of the centroids
+  real *point_norms, *centroid_norms;
+  // the centroids, d x k
+  real *centroids_t;
+
+  // per slice
+  assign_stats_t *slice_stats;
+};
+
+struct sparse_args_t {
+  sparse_shared_t *shared;
+  int slice_start, slice_end;
+  // the k dot products of a point
+  real *dots;
+};
+
+static int slice_point_start(int n_points, int slice) {
+  return (int)((long)n_points * slice / SPARSE_SLICES);
+}
+
+static void densify_point(csr_points_t *points, int i, real *point) {
+  std::memset(point, 0, points->d * sizeof(real));
+  for (long j = points->row_start[i]; j < points->row_start[i + 1]; j++) {
+    point[points->cols[j]] = points->vals[j];
+  }
+}
+
+void k_means_init_random_sparse(csr_points_t *points, int k, real *centroids,
+    int seed) {
+  k_means_srand(seed);
+  for (int i = 0; i < k; i++) {
+    int index = k_means_rand() % points->n_points;
+    densify_point(points, index, &centroids[i * points->d]);
+  }
+}
+
+static void assign_slice(sparse_args_t *args, int slice) {
+  sparse_shared_t *shared = args->shared;
+  csr_points_t *points = shared->points;
+  int k = shared->k;
+  real *dots = args->dots;
+
+  assign_stats_t *stats = &shared->slice_stats[slice];
+  stats->reassigned = 0;
+  stats->inertia = 0;
+
+  int start = slice_point_start(points->n_points, slice);
+  int end = slice_point_start(points->n_points, slice + 1);
+
+  for (int i = start; i < end; i++) {
+    std::memset(dots, 0, k * sizeof(real));
+    for (long j = points->row_start[i]; j < points->row_start[i + 1]; j++) {
+      real v = points->vals[j];
+      const real *column = &shared->centroids_t[(long)points->cols[j] * k];
+      for (int c = 0; c < k; c++) {
+        dots[c] += v * column[c];
+      }
+    }
+
+    int nearest = 0;
+    real nearest_dist = shared->centroid_norms[0] - 2 * dots[0];
+    for (int c = 1; c < k; c++) {
+      real dist = shared->centroid_norms[c] - 2 * dots[c];
+      if (dist < nearest_dist) {
+        nearest_dist = dist;
+        nearest = c;
+      }
+    }
+
+    // the expansion can round below 0
+    real dist_2 = shared->point_norms[i] + nearest_dist;
+    stats->inertia += dist_2 > 0 ? dist_2 : 0;
+    stats->reassigned += shared->point_cluster_ids[i] != nearest;
+    shared->point_cluster_ids[i] = nearest;
+  }
+}
+
+static void *sparse_thread(void *a) {
+  sparse_args_t *args = (sparse_args_t *)a;
+
+  for (int s = args->slice_start; s < args->slice_end; s++) {
+    assign_slice(args, s);
+  }
+
+  return 0;
+}
+
+int k_means_sparse(csr_points_t *points, struct options_t *opts,
+    int* point_cluster_ids, real** centroids) {
+
+  int n_points = points->n_points;
+  int k = opts->n_clusters;
+  int d = opts->dimensions;
+  int n_threads = opts->n_threads < SPARSE_SLICES ? opts->n_threads : SPARSE_SLICES;
+
+  real *centroids_1 = *centroids;
+  real *centroids_2 = (real *)malloc(k * d * sizeof(real));
+  int *k_counts = (int *)malloc(k * sizeof(int));
+
+  sparse_shared_t shared;
+  shared.points = points;
+  shared.k = k;
+  shared.point_cluster_ids = point_cluster_ids;
+  shared.point_norms = (real *)malloc(n_points * sizeof(real));
+  shared.centroid_norms = (real *)malloc(k * sizeof(real));
+  shared.centroids_t = (real *)malloc((long)d * k * sizeof(real));
+  shared.slice_stats = (assign_stats_t *)malloc(SPARSE_SLICES * sizeof(assign_stats_t));
+
+  for (int i = 0; i < n_points; i++) {
+    shared.point_norms[i] = 0;
+    for (long j = points->row_start[i]; j < points->row_start[i + 1]; j++) {
+      shared.point_norms[i] += POW2(points->vals[j]);
+    }
+  }
+
+  sparse_args_t *args = (sparse_args_t *)malloc(n_threads * sizeof(sparse_args_t));
+  pthread_t *threads = (pthread_t *)malloc(n_threads * sizeof(pthread_t));
+  for (int t = 0; t < n_threads; t++) {
+    args[t].shared = &shared;
+    args[t].slice_start = SPARSE_SLICES * t / n_threads;
+    args[t].slice_end = SPARSE_SLICES * (t + 1) / n_threads;
+    args[t].dots = (real *)malloc(k * sizeof(real));
+  }
+
+  // nothing is assigned yet, every point counts as reassigned
+  for (int i = 0; i < n_points; i++) {
+    point_cluster_ids[i] = -1;
+  }
+
+  bool done = false;
+  int iterations = 0;
+  real **old_centroids = &centroids_1;
+  real **new_centroids = &centroids_2;
+
+  while(!done) {
+    real *c_old = *old_centroids;
+    for (int c = 0; c < k; c++) {
+      shared.centroid_norms[c] = 0;
+      for (int l = 0; l < d; l++) {
+        shared.centroid_norms[c] += POW2(c_old[c*d + l]);
+        shared.centroids_t[(long)l*k + c] = c_old[c*d + l];
+      }
+    }
+
+    if (n_threads == 1) {
+      sparse_thread(&args[0]);
+    }
+    else {
+      for (int t = 0; t < n_threads; t++) {
+        HANDLE(pthread_create(&threads[t], NULL, sparse_thread, (void *)&args[t]));
+      }
+      for (int t = 0; t < n_threads; t++) {
+        HANDLE(pthread_join(threads[t], NULL));
+      }
+    }
+
+    // in slice order, so the results don't depend on the thread count
+    assign_stats_t stats;
+    stats.reassigned = 0;
+    stats.inertia = 0;
+    for (int s = 0; s < SPARSE_SLICES; s++) {
+      stats.reassigned += shared.slice_stats[s].reassigned;
+      stats.inertia += shared.slice_stats[s].inertia;
+    }
+    TIMING_PRINT(printf("reassigned %d inertia %lf\n", stats.reassigned, stats.inertia));
+
+    // the nonzeros into the sums, in point order like k_means_sequential
+    real *sums = *new_centroids;
+    std::memset(k_counts, 0, sizeof(int) * k);
+    std::memset(sums, 0, sizeof(real) * d * k);
+    for (int i = 0; i < n_points; i++) {
+      int c = point_cluster_ids[i];
+      k_counts[c]++;
+      for (long j = points->row_start[i]; j < points->row_start[i + 1]; j++) {
+        sums[c*d + points->cols[j]] += points->vals[j];
+      }
+    }
+
+    for (int c = 0; c < k; c++) {
+      if (k_counts[c] == 0) {
+        // if the centroid "vanished"
+        int index = k_means_rand() % n_points;
+        densify_point(points, index, &sums[c*d]);
+      }
+      else {
+        for (int l = 0; l < d; l++) {
+          sums[c*d + l] /= k_counts[c];
+        }
+      }
+    }
+
+    // swap centroids
+    *centroids = *new_centroids;
+    *new_centroids = *old_centroids;
+    *old_centroids = *centroids;
+
+    iterations++;
+    DEBUG_OUT(iterations);
+    done = (iterations > opts->max_iterations) ||
+      converged(k, d, opts->threshold, centroids_1, centroids_2);
+  }
+
+  for (int t = 0; t < n_threads; t++) {
+    free(args[t].dots);
+  }
+  free(args);
+  free(threads);
+  free(*new_centroids);
+  free(k_counts);
+  free(shared.point_norms);
+  free(shared.centroid_norms);
+  free(shared.centroids_t);
+  free(shared.slice_stats);
+
+  return iterations;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "common.h"
+#include "argparse.h"
+#include "io.h"
+
+// the points are assigned in this many fixed slices, split among the threads
+#define SPARSE_SLICES 256
+
+// k-means++ and k-means|| need distances to the points; the sparse points
+// are seeded with random points only, the same ones as
+// k_means_init_random_centroids
+void k_means_init_random_sparse(csr_points_t *points, int k, real *centroids,
+    int seed);
+
+// Lloyd's k-means of CSR points against dense centroids. The squared
+// distances are ||x||^2 - 2 x.c + ||c||^2, with the point norms computed
+// once, the centroid norms every iteration, and x.c over the nonzeros of x
+// only, against a d x k transposed copy of the centroids so the k products
+// of a nonzero are contiguous. The centroid sums only add the nonzeros, so
+// an iteration costs O(nnz * k + d * k) instead of O(n * d * k).
+int k_means_sparse(csr_points_t *points, struct options_t *opts,
+    int* point_cluster_ids, real** centroids);
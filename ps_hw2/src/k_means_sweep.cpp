@@ -0,0 +1,281 @@
+#include <cstring>
+#include <pthread.h>
+#include "common.h"
+#include "k_means_sweep.h"
+#include "k_means_sequential.h"
+#include "k_means_kernels.h"
+#include "argparse.h"
+#include "seed.h"
+
+struct sweep_shared_t {
+  int n_points;
+  real *points;
+  // squared norm of every point
+  real *norms;
+  struct options_t *opts;
+  nearest_centroids_t nearest_centroids;
+
+  // the running solution, for up to k_max clusters
+  int k;
+  int *ids;
+  real *centroids_1, *centroids_2;
+  int *k_counts;
+  double *sse;
+
+  // the centroid sums, counts and inertia of every slice's points, added up
+  // in slice order so the results don't depend on the threads
+  int n_slices;
+  real *slice_sums;
+  int *slice_counts;
+  double *slice_inertia;
+};
+
+struct sweep_args_t {
+  sweep_shared_t *shared;
+  int slice_start, slice_end;
+  // the centroids to assign to
+  const real *centroids;
+};
+
+static int slice_point_start(int n_points, int n_slices, int slice) {
+  return (int)((long)n_points * slice / n_slices);
+}
+
+static void *assign_slices(void *a) {
+  sweep_args_t *args = (sweep_args_t *)a;
+  sweep_shared_t *shared = args->shared;
+  int d = shared->opts->dimensions;
+  int k = shared->k;
+
+  for (int s = args->slice_start; s < args->slice_end; s++) {
+    int start = slice_point_start(shared->n_points, shared->n_slices, s);
+    int end = slice_point_start(shared->n_points, shared->n_slices, s + 1);
+    real *sums = &shared->slice_sums[(long)s * k * d];
+    int *counts = &shared->slice_counts[(long)s * k];
+
+    std::memset(sums, 0, sizeof(real) * k * d);
+    std::memset(counts, 0, sizeof(int) * k);
+    shared->slice_inertia[s] = assign_and_accumulate(end - start, d,
+        &shared->points[(long)start * d], &shared->ids[start], k, counts, sums,
+        (real *)args->centroids, shared->nearest_centroids).inertia;
+  }
+
+  return 0;
+}
+
+// assigns every point to the nearest of centroids, with the sums and counts
+// of the new centroids in new_centroids and shared->k_counts; returns the
+// inertia
+static double assign(sweep_shared_t *shared, const real *centroids,
+    real *new_centroids) {
+  int d = shared->opts->dimensions;
+  int k = shared->k;
+  int n_threads = shared->opts->n_threads < shared->n_slices ?
+    shared->opts->n_threads : shared->n_slices;
+  if (n_threads < 1) {
+    n_threads = 1;
+  }
+
+  sweep_args_t *args = (sweep_args_t *)malloc(n_threads * sizeof(sweep_args_t));
+  pthread_t *threads = (pthread_t *)malloc(n_threads * sizeof(pthread_t));
+
+  for (int t = 0; t < n_threads; t++) {
+    args[t].shared = shared;
+    args[t].slice_start = (int)((long)shared->n_slices * t / n_threads);
+    args[t].slice_end = (int)((long)shared->n_slices * (t + 1) / n_threads);
+    args[t].centroids = centroids;
+  }
+
+  if (n_threads == 1) {
+    assign_slices(&args[0]);
+  }
+  else {
+    for (int t = 0; t < n_threads; t++) {
+      HANDLE(pthread_create(&threads[t], NULL, assign_slices, (void *)&args[t]));
+    }
+    for (int t = 0; t < n_threads; t++) {
+      HANDLE(pthread_join(threads[t], NULL));
+    }
+  }
+
+  free(args);
+  free(threads);
+
+  std::memset(shared->k_counts, 0, sizeof(int) * k);
+  std::memset(new_centroids, 0, sizeof(real) * d * k);
+  double inertia = 0;
+  for (int s = 0; s < shared->n_slices; s++) {
+    const real *sums = &shared->slice_sums[(long)s * k * d];
+    const int *counts = &shared->slice_counts[(long)s * k];
+
+    for (int j = 0; j < k * d; j++) {
+      new_centroids[j] += sums[j];
+    }
+    for (int j = 0; j < k; j++) {
+      shared->k_counts[j] += counts[j];
+    }
+    inertia += shared->slice_inertia[s];
+  }
+
+  return inertia;
+}
+
+// Lloyd's from the centroids in centroids_1, which hold the result after;
+// returns the inertia of the last assignment
+static double lloyd(sweep_shared_t *shared, int *iterations,
+    k_means_rand_t *rand_state) {
+  struct options_t *opts = shared->opts;
+  int n_points = shared->n_points;
+  real *points = shared->points;
+  int d = opts->dimensions;
+  int k = shared->k;
+
+  for (int i = 0; i < n_points; i++) {
+    shared->ids[i] = -1;
+  }
+
+  bool done = false;
+  double inertia = 0;
+  *iterations = 0;
+  real *old_centroids = shared->centroids_1;
+  real *new_centroids = shared->centroids_2;
+
+  while(!done) {
+    inertia = assign(shared, old_centroids, new_centroids);
+
+    finish_new_centroids_r(n_points, d, points, k, shared->k_counts,
+        new_centroids, rand_state);
+
+    // swap centroids
+    real *temp_centroids = new_centroids;
+    new_centroids = old_centroids;
+    old_centroids = temp_centroids;
+
+    (*iterations)++;
+    done = (*iterations > opts->max_iterations) ||
+      converged(k, d, opts->threshold, shared->centroids_1, shared->centroids_2);
+  }
+
+  if (old_centroids != shared->centroids_1) {
+    shared->centroids_2 = shared->centroids_1;
+    shared->centroids_1 = old_centroids;
+  }
+
+  return inertia;
+}
+
+// adds centroid k: splits the cluster of the highest SSE around its mean,
+// with sum ||x - m||^2 = sum ||x||^2 - n ||m||^2 over its points
+static void split_cluster(sweep_shared_t *shared, int k) {
+  int n_points = shared->n_points;
+  real *points = shared->points;
+  int d = shared->opts->dimensions;
+  real *centroids = shared->centroids_1;
+
+  std::memset(shared->sse, 0, k * sizeof(double));
+  for (int i = 0; i < n_points; i++) {
+    shared->sse[shared->ids[i]] += shared->norms[i];
+  }
+
+  int split = 0;
+  for (int j = 0; j < k; j++) {
+    double norm = 0;
+    for (int l = 0; l < d; l++) {
+      norm += POW2(centroids[j*d + l]);
+    }
+    shared->sse[j] -= shared->k_counts[j] * norm;
+
+    if (shared->sse[j] > shared->sse[split]) {
+      split = j;
+    }
+  }
+
+  // the split cluster's point furthest from its mean
+  int furthest = -1;
+  real furthest_dist = -1;
+  for (int i = 0; i < n_points; i++) {
+    if (shared->ids[i] != split) {
+      continue;
+    }
+
+    real dist_2 = 0;
+    for (int l = 0; l < d; l++) {
+      dist_2 += POW2(points[i*d + l] - centroids[split*d + l]);
+    }
+    if (dist_2 > furthest_dist) {
+      furthest_dist = dist_2;
+      furthest = i;
+    }
+  }
+
+  std::memcpy(&centroids[k*d], &points[(furthest < 0 ? 0 : furthest) * d],
+      d * sizeof(real));
+}
+
+void k_means_sweep(int n_points, real *points, struct options_t *opts,
+    double *inertia, int *iterations) {
+
+  int d = opts->dimensions;
+  int k_max = opts->k_max;
+
+  sweep_shared_t shared;
+  shared.n_points = n_points;
+  shared.points = points;
+  shared.opts = opts;
+  shared.nearest_centroids = select_nearest_centroids(opts->assign);
+  shared.ids = (int *)malloc(n_points * sizeof(int));
+  shared.centroids_1 = (real *)malloc(k_max * d * sizeof(real));
+  shared.centroids_2 = (real *)malloc(k_max * d * sizeof(real));
+  shared.k_counts = (int *)malloc(k_max * sizeof(int));
+  shared.sse = (double *)malloc(k_max * sizeof(double));
+  shared.n_slices = n_points < SWEEP_SLICES ? n_points : SWEEP_SLICES;
+  shared.slice_sums = (real *)malloc((long)shared.n_slices * k_max * d * sizeof(real));
+  shared.slice_counts = (int *)malloc((long)shared.n_slices * k_max * sizeof(int));
+  shared.slice_inertia = (double *)malloc(shared.n_slices * sizeof(double));
+
+  shared.norms = (real *)malloc(n_points * sizeof(real));
+  for (int i = 0; i < n_points; i++) {
+    shared.norms[i] = 0;
+    for (int l = 0; l < d; l++) {
+      shared.norms[i] += POW2(points[i*d + l]);
+    }
+  }
+
+  // only k_min is seeded like a plain run
+  k_means_rand_t rand_state = opts->seed;
+  switch (opts->init)
+  {
+    case 1:
+      k_means_init_plus_plus_r(n_points, d, points, opts->k_min,
+          shared.centroids_1, &rand_state, opts->n_threads);
+      break;
+    case 2:
+      k_means_init_parallel_r(n_points, d, points, opts->k_min,
+          shared.centroids_1, &rand_state, opts->n_threads);
+      break;
+    default:
+      k_means_init_random_centroids_r(n_points, d, points, opts->k_min,
+          shared.centroids_1, &rand_state);
+  }
+
+  for (int k = opts->k_min; k <= k_max; k++) {
+    if (k > opts->k_min) {
+      split_cluster(&shared, k - 1);
+    }
+
+    shared.k = k;
+    inertia[k - opts->k_min] = lloyd(&shared, &iterations[k - opts->k_min], &rand_state);
+    DEBUG_PRINT(printf("k %d inertia %lf iterations %d\n", k,
+          inertia[k - opts->k_min], iterations[k - opts->k_min]));
+  }
+
+  free(shared.ids);
+  free(shared.centroids_1);
+  free(shared.centroids_2);
+  free(shared.k_counts);
+  free(shared.sse);
+  free(shared.slice_sums);
+  free(shared.slice_counts);
+  free(shared.slice_inertia);
+  free(shared.norms);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "common.h"
+#include "argparse.h"
+
+// fixed point slices of the assignment, whatever the thread count
+#define SWEEP_SLICES 32
+
+// Lloyd's k-means for every k in [opts->k_min, opts->k_max], for choosing k
+// by the elbow of the inertia. Only k_min is seeded by opts->init; every
+// next k starts from the previous solution with the cluster of the highest
+// SSE split, a new centroid on its point furthest from the mean, so the
+// inertia curve has no cold restarts. The k values run one after the other,
+// each assignment over SWEEP_SLICES slices on opts->n_threads threads. The
+// per-cluster SSEs come from the point norms, computed once. Fills inertia
+// and iterations, indexed by k - opts->k_min.
+void k_means_sweep(int n_points, real *points, struct options_t *opts,
+    double *inertia, int *iterations);
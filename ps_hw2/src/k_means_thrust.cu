@@ -1,21 +1,37 @@
 #include <iostream>
+#include <iterator>
 
 #include <thrust/device_vector.h>
+#include <thrust/host_vector.h>
+#include <thrust/functional.h>
+#include <thrust/iterator/constant_iterator.h>
 #include <thrust/iterator/discard_iterator.h>
 #include <thrust/iterator/counting_iterator.h>
 #include <thrust/iterator/transform_iterator.h>
 #include <thrust/iterator/zip_iterator.h>
 #include <thrust/reduce.h>
 #include <thrust/copy.h>
+#include <thrust/fill.h>
+#include <thrust/for_each.h>
 #include <thrust/logical.h>
+#include <thrust/sort.h>
+#include <thrust/transform.h>
+#include <thrust/transform_reduce.h>
 
 #include "k_means_thrust.h"
 #include "common.h"
+#include "seed.h"
 
 typedef thrust::device_vector<real> dv_real;
 typedef thrust::device_vector<int> dv_int;
 typedef thrust::host_vector<real> hv_real;
 
+// Built by nvcc for the GPU, or by a host compiler with THRUST_DEVICE_SYSTEM
+// set to OMP or TBB (make thrust_omp/thrust_tbb), where the device vectors
+// live in host memory. Newer CCCL releases no longer define __host__ and
+// __device__ away for host compilers, so they are defined here.
+#ifdef __CUDACC__
+
 // referenced from piazza, which references NVidia
 __device__ double datomicAdd(double* address, double val)
 {
@@ -31,6 +47,75 @@ __device__ double datomicAdd(double* address, double val)
   return __longlong_as_double(old);
 }
 
+static __device__ void ratomicAdd(real* address, real val)
+{
+#ifdef REAL_FLOAT
+  atomicAdd(address, val);
+#else
+  datomicAdd(address, val);
+#endif
+}
+
+typedef cudaEvent_t timer_event_t;
+
+static void timer_event_create(timer_event_t *event) {
+  cudaEventCreate(event);
+}
+
+static void timer_event_record(timer_event_t *event) {
+  cudaEventRecord(*event, 0);
+}
+
+static void timer_event_synchronize(timer_event_t *event) {
+  cudaEventSynchronize(*event);
+}
+
+static float timer_elapsed_time(timer_event_t *start, timer_event_t *stop) {
+  float ms;
+  cudaEventElapsedTime(&ms, *start, *stop);
+  return ms;
+}
+
+#else
+
+#include <chrono>
+
+#ifndef __host__
+#define __host__
+#endif
+#ifndef __device__
+#define __device__
+#endif
+
+// the same compare-and-swap loop, for the host threads of OMP/TBB
+static inline void ratomicAdd(real* address, real val)
+{
+  real old = *address, sum;
+  do {
+    sum = old + val;
+  } while (!__atomic_compare_exchange(address, &old, &sum, true,
+        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+// the host algorithms run synchronously
+typedef std::chrono::high_resolution_clock::time_point timer_event_t;
+
+static void timer_event_create(timer_event_t *event) {
+}
+
+static void timer_event_record(timer_event_t *event) {
+  *event = std::chrono::high_resolution_clock::now();
+}
+
+static void timer_event_synchronize(timer_event_t *event) {
+}
+
+static float timer_elapsed_time(timer_event_t *start, timer_event_t *stop) {
+  return std::chrono::duration<float, std::milli>(*stop - *start).count();
+}
+
+#endif
+
 #define D_PRINT_POINT(x, d, i) { \
   if(DEBUG_TEST) {\
     thrust::copy_n( \
@@ -58,7 +143,7 @@ typedef thrust::tuple<real, real> two_realz;
 
 // map an index -> component l of point index i and centroid index j
 // and then compute the distance component of l
-struct distance_component : public thrust::unary_function<int, real> {
+struct distance_component {
   const int d, k;
   const real *points, *centroids;
 
@@ -66,7 +151,7 @@ struct distance_component : public thrust::unary_function<int, real> {
     : d(_d), k(_k), points(_points), centroids(_centroids) {}
 
   __host__ __device__
-  real operator()(int index) {
+  real operator()(int index) const {
     int i = (index / d) / k;
     int j = (index / d) % k;
     int l = index % d;
@@ -78,7 +163,7 @@ struct distance_component : public thrust::unary_function<int, real> {
 };
 
 // sum up each point component into a new centroid
-struct centroid_means : public thrust::unary_function<void, real_indexed> {
+struct centroid_means {
   const int d;
   const int *d_point_cluster_ids;
   real *centroids;
@@ -88,22 +173,18 @@ struct centroid_means : public thrust::unary_function<void, real_indexed> {
     centroids(_centroids) {}
 
   __device__
-  void operator()(real_indexed real_index) {
+  void operator()(real_indexed real_index) const {
     real value = thrust::get<0>(real_index);
     int index = thrust::get<1>(real_index);
     int target_centroid_id = d_point_cluster_ids[index / d];
     int target_centroid_component_id = target_centroid_id*d + index % d;
     // printf("%lf %i %i %i\n", value, index, target_centroid_id, target_centroid_component_id);
 
-#ifdef REAL_FLOAT
-    atomicAdd(centroids + target_centroid_component_id, value);
-#else
-    datomicAdd(centroids + target_centroid_component_id, value);
-#endif
+    ratomicAdd(centroids + target_centroid_component_id, value);
   }
 };
 
-struct centroid_divide : public thrust::unary_function<void, two_ints> {
+struct centroid_divide {
   const int d, i;
   real *centroids;
 
@@ -111,7 +192,7 @@ struct centroid_divide : public thrust::unary_function<void, two_ints> {
     : d(_d), i(_i), centroids(_centroids) {}
 
   __device__
-  void operator()(two_ints ints) {
+  void operator()(two_ints ints) const {
     int centroid_id = thrust::get<0>(ints);
     int counts = thrust::get<1>(ints);
 
@@ -121,7 +202,7 @@ struct centroid_divide : public thrust::unary_function<void, two_ints> {
 
 //functor that makes point component indexes equivalent based on a map
 //in a n_points * k array
-struct point_component_centroid_id : public thrust::binary_function<int, int, int> {
+struct point_component_centroid_id {
   const int d;
   const int *point_cluster_ids;
   const real *centroids;
@@ -130,32 +211,32 @@ struct point_component_centroid_id : public thrust::binary_function<int, int, in
     : d(_d), point_cluster_ids(_point_cluster_ids), centroids(_centroids) {}
 
   __host__ __device__
-  int operator()(int index) {
+  int operator()(int index) const {
     return point_cluster_ids[index / d] * d + index % d;
   }
 };
 
 //binary function for a maximum on the first member of a tuple
-struct maximum_by_first : public thrust::binary_function<real_indexed, real_indexed, real_indexed> {
+struct maximum_by_first {
   maximum_by_first() {}
 
   __host__ __device__
-  real_indexed operator()(real_indexed x_1, real_indexed x_2) {
+  real_indexed operator()(real_indexed x_1, real_indexed x_2) const {
     return thrust::get<0>(x_1) < thrust::get<0>(x_2) ? x_1 : x_2;
   }
 };
 
-struct l1_op : public thrust::unary_function<bool, two_realz> {
+struct l1_op {
   const real l1_thresh;
   l1_op(real _l1_thresh) : l1_thresh(_l1_thresh) {}
 
   __host__ __device__
-  bool operator()(two_realz realz) {
-    // (_1 - _2 < 0 ? _2 - _1 : _1 - _2) < l1_thresh
+  bool operator()(two_realz realz) const {
     real x1 = thrust::get<0>(realz);
     real x2 = thrust::get<1>(realz);
 
-    return abs(x1 - x2) < l1_thresh;
+    // not abs, which is the int one in host builds
+    return (x1 - x2 < 0 ? x2 - x1 : x1 - x2) < l1_thresh;
   }
 };
 
@@ -172,28 +253,27 @@ int k_means_thrust(int n_points, real *points, struct options_t *opts,
   int k = opts->n_clusters;
   int d = opts->dimensions;
 
-  cudaEvent_t start, stop, in_start, in_stop, out_start, out_stop;
+  timer_event_t start, stop, in_start, in_stop, out_start, out_stop;
 
-  cudaEventCreate(&start);
-  cudaEventCreate(&stop);
-  cudaEventCreate(&in_start);
-  cudaEventCreate(&in_stop);
-  cudaEventCreate(&out_start);
-  cudaEventCreate(&out_stop);
+  timer_event_create(&start);
+  timer_event_create(&stop);
+  timer_event_create(&in_start);
+  timer_event_create(&in_stop);
+  timer_event_create(&out_start);
+  timer_event_create(&out_stop);
 
   // timer code - 0_Simple/simpleMultiCopy/simpleMultiCopy.cu
-  cudaEventRecord(start, 0);
-  cudaEventRecord(in_start, 0);
+  timer_event_record(&start);
+  timer_event_record(&in_start);
 
   dv_real d_points(points, points + n_points * d);
 
   dv_real old_centroids(*centroids, *centroids + k * d);
 
-  cudaEventRecord(in_stop,0);
-  cudaEventSynchronize(in_stop);
+  timer_event_record(&in_stop);
+  timer_event_synchronize(&in_stop);
 
-  float memcpy_h2d_time;
-  cudaEventElapsedTime(&memcpy_h2d_time, in_start, in_stop);
+  float memcpy_h2d_time = timer_elapsed_time(&in_start, &in_stop);
   TIMING_PRINT(printf("Host to device: %f ms \n", memcpy_h2d_time));
 
   dv_real new_centroids(k * d);
@@ -321,6 +401,19 @@ int k_means_thrust(int n_points, real *points, struct options_t *opts,
       );
     }
 
+    // respawn the vanished centroids on a k_means_rand point, like
+    // finish_new_centroids, instead of leaving them at the origin
+    host_vector<int> h_k_count_keys(d_k_count_keys.begin(), new_end.first);
+    int n_keys = h_k_count_keys.size();
+    for (int i = 0, j = 0; i < k; i++) {
+      if (j < n_keys && h_k_count_keys[j] == i) {
+        j++;
+        continue;
+      }
+      int index = k_means_rand() % n_points;
+      copy_n(d_points.begin() + index*d, d, new_centroids.begin() + i*d);
+    }
+
     DEBUG_OUT("new_centroids means");
     D_PRINT_ALL(new_centroids);
 
@@ -346,23 +439,21 @@ int k_means_thrust(int n_points, real *points, struct options_t *opts,
 
   DEBUG_OUT(iterations > opts->max_iterations ? "Max iterations reached!" : "Converged!" );
 
-  cudaEventRecord(out_start, 0);
+  timer_event_record(&out_start);
 
   copy(old_centroids.begin(), old_centroids.end(), *centroids);
   copy(unsorted_d_point_cluster_ids.begin(), unsorted_d_point_cluster_ids.end(), point_cluster_ids);
 
-  cudaEventRecord(out_stop,0);
-  cudaEventSynchronize(out_stop);
+  timer_event_record(&out_stop);
+  timer_event_synchronize(&out_stop);
 
-  float memcpy_d2h_time;
-  cudaEventElapsedTime(&memcpy_d2h_time, out_start, out_stop); //TODO: is async messing it up?
+  float memcpy_d2h_time = timer_elapsed_time(&out_start, &out_stop); //TODO: is async messing it up?
   TIMING_PRINT(printf("Device to host: %f ms \n", memcpy_d2h_time));
 
-  cudaEventRecord(stop,0);
-  cudaEventSynchronize(stop);
+  timer_event_record(&stop);
+  timer_event_synchronize(&stop);
 
-  float global_time;
-  cudaEventElapsedTime(&global_time, start, stop); //TODO: is async messing it up?
+  float global_time = timer_elapsed_time(&start, &stop); //TODO: is async messing it up?
   *per_iteration_time = (global_time/iterations);
   TIMING_PRINT(printf("Overall: %f ms \n", global_time));
   TIMING_PRINT(printf("Percent spent in IO: %f \n", (memcpy_d2h_time + memcpy_h2d_time) / global_time));
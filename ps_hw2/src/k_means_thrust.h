@@ -1,7 +1,5 @@
 #pragma once
 
-#include <thrust/functional.h>
-
 #include "common.h"
 #include "argparse.h"
 
@@ -2,25 +2,173 @@
 #include <cfloat>
 #include "argparse.h"
 #include "io.h"
+#include "output.h"
 #include "common.h"
+#include "phases.h"
 #include "seed.h"
 #include "k_means_sequential.h"
+#include "k_means_restarts.h"
+#include "k_means_sweep.h"
+#include "k_means_sparse.h"
+#include "k_means_cpu.h"
+#include "k_means_bounds.h"
+#include "k_means_minibatch.h"
+#include "k_means_kdtree.h"
+#include "k_means_ivf.h"
+#include "k_means_predict.h"
+#include "k_means_outofcore.h"
+#include "k_means_mpi.h"
 #include "k_means_thrust.h"
 #include "k_means_cuda.h"
 
+// kmeans predict: the points of opts->in_file to the nearest of the trained
+// centroids in opts->centroids; prints n_points,ms,points_per_s
+static int predict(struct options_t *opts) {
+  if (opts->centroids == NULL) {
+    std::cerr << "predict needs --centroids" << std::endl;
+    exit(1);
+  }
+
+  int k;
+  real *centroids;
+  read_centroids(opts, &k, &centroids);
+
+  int n_points;
+  real *points;
+  read_file(opts, &n_points, &points);
+
+  int *ids = (int *)malloc(n_points * sizeof(int));
+  real *dists = opts->distances != NULL ? (real *)malloc(n_points * sizeof(real)) : NULL;
+
+  k_means_model_t model;
+  k_means_model_init(&model, k, opts->dimensions, centroids, opts->assign);
+
+  auto start = std::chrono::high_resolution_clock::now();
+  k_means_predict(&model, n_points, points, ids, dists, opts->n_threads);
+  auto end = std::chrono::high_resolution_clock::now();
+  double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+  char header[128];
+  snprintf(header, sizeof(header), "%d,%lf,%lf\n", n_points, ms, n_points / (ms / 1000));
+
+  opts->print_centroids = false;
+  write_results(opts, header, n_points, ids, k, centroids);
+  if (dists != NULL) {
+    write_raw_file(opts->distances, dists, n_points * sizeof(real));
+  }
+
+  k_means_model_free(&model);
+  free(ids);
+  free(dists);
+  free(centroids);
+  free_points(points);
+
+  return 0;
+}
+
 int main(int argc, char **argv) {
   // Parse args
   struct options_t opts;
   get_opts(argc, argv, &opts);
 
-  int n_points;
-  real *points;
-  read_file(&opts, &n_points, &points);
+  if (opts.predict) {
+    return predict(&opts);
+  }
+
+  // streamed mini-batch, out-of-core and MPI read the file themselves
+  bool streamed = (opts.algorithm == 6 && opts.stream) || opts.algorithm == 8 ||
+    opts.algorithm == 9;
+
+  if (opts.k_max > 0 && streamed) {
+    std::cerr << "-K needs the points in memory, not -a 6 -S, -a 8 or -a 9" << std::endl;
+    exit(1);
+  }
+  // the restarts are runs of the sequential algorithm
+  if (opts.restarts > 1 && (opts.algorithm != 0 || opts.k_max > 0)) {
+    std::cerr << "-R only restarts algorithm 0, and not with -K" << std::endl;
+    exit(1);
+  }
+  // they pick their own random points from the file
+  if (opts.init != 0 && streamed) {
+    std::cerr << "-I needs the points in memory, not -a 6 -S, -a 8 or -a 9" << std::endl;
+    exit(1);
+  }
+  if (opts.k_max <= 0 && opts.n_clusters <= 0 && opts.convert == NULL) {
+    std::cerr << "-k needs a positive number of clusters" << std::endl;
+    exit(1);
+  }
 
-  int *point_cluster_ids = (int *)malloc(n_points * sizeof(int));
+  int n_points;
+  real *points = NULL;
+  int *point_cluster_ids = NULL;
   real *centroids = (real *)malloc(opts.n_clusters * opts.dimensions * sizeof(real));
-  k_means_init_random_centroids(n_points, opts.dimensions, points,
-      opts.n_clusters, centroids, opts.seed);
+
+  // CSR points, for opts.sparse
+  csr_points_t sparse_points;
+
+  if (opts.sparse) {
+    if (opts.algorithm != 0 && opts.algorithm != 4) {
+      std::cerr << "sparse points need algorithm 0 or 4" << std::endl;
+      exit(1);
+    }
+    if (opts.init != 0 || opts.restarts > 1 || opts.k_max > 0) {
+      std::cerr << "sparse points don't support -I, -R or -K" << std::endl;
+      exit(1);
+    }
+
+    read_sparse_file(&opts, &sparse_points);
+    n_points = sparse_points.n_points;
+    point_cluster_ids = (int *)malloc(n_points * sizeof(int));
+    k_means_init_random_sparse(&sparse_points, opts.n_clusters, centroids, opts.seed);
+  }
+  else if (!streamed) {
+    read_file(&opts, &n_points, &points);
+
+    if (opts.convert != NULL) {
+      write_binary_file(opts.convert, n_points, opts.dimensions, points);
+      free_points(points);
+      free(centroids);
+      return 0;
+    }
+
+    if (opts.k_max > 0) {
+      int n_k = opts.k_max - opts.k_min + 1;
+      double *inertia = (double *)malloc(n_k * sizeof(double));
+      int *sweep_iterations = (int *)malloc(n_k * sizeof(int));
+
+      auto start = std::chrono::high_resolution_clock::now();
+      k_means_sweep(n_points, points, &opts, inertia, sweep_iterations);
+      auto end = std::chrono::high_resolution_clock::now();
+      TIMING_PRINT(printf("sweep: %f ms\n", std::chrono::duration<double, std::milli>(end - start).count()));
+
+      printf("k,inertia,iterations\n");
+      for (int i = 0; i < n_k; i++) {
+        printf("%d,%lf,%d\n", opts.k_min + i, inertia[i], sweep_iterations[i]);
+      }
+
+      free(inertia);
+      free(sweep_iterations);
+      free_points(points);
+      free(centroids);
+      return 0;
+    }
+
+    point_cluster_ids = (int *)malloc(n_points * sizeof(int));
+    switch (opts.init)
+    {
+      case 1:
+        k_means_init_plus_plus(n_points, opts.dimensions, points,
+            opts.n_clusters, centroids, opts.seed, opts.n_threads);
+        break;
+      case 2:
+        k_means_init_parallel(n_points, opts.dimensions, points,
+            opts.n_clusters, centroids, opts.seed, opts.n_threads);
+        break;
+      default:
+        k_means_init_random_centroids(n_points, opts.dimensions, points,
+            opts.n_clusters, centroids, opts.seed);
+    }
+  }
 
   int iterations = 0;
   double per_iteration_time = 0;
@@ -33,7 +181,15 @@ int main(int argc, char **argv) {
     case 0:
       DEBUG_OUT("Running k_means_sequential:");
 
-      iterations = k_means_sequential(n_points, points, &opts, point_cluster_ids, &centroids);
+      if (opts.sparse) {
+        iterations = k_means_sparse(&sparse_points, &opts, point_cluster_ids, &centroids);
+      }
+      else if (opts.restarts > 1) {
+        iterations = k_means_restarts(n_points, points, &opts, point_cluster_ids, &centroids);
+      }
+      else {
+        iterations = k_means_sequential(n_points, points, &opts, point_cluster_ids, &centroids);
+      }
 
       DEBUG_OUT("Finished k_means_sequential:");
       break;
@@ -58,31 +214,97 @@ int main(int argc, char **argv) {
 
       DEBUG_OUT("Finished k_means_cuda shmem:");
       break;
+    case 4:
+      DEBUG_OUT("Running k_means_cpu:");
+
+      if (opts.sparse) {
+        iterations = k_means_sparse(&sparse_points, &opts, point_cluster_ids, &centroids);
+      }
+      else {
+        iterations = k_means_cpu(n_points, points, &opts, point_cluster_ids, &centroids);
+      }
+
+      DEBUG_OUT("Finished k_means_cpu:");
+      break;
+    case 5:
+      DEBUG_OUT("Running k_means_bounds:");
+
+      iterations = k_means_bounds(n_points, points, &opts, point_cluster_ids, &centroids);
+
+      DEBUG_OUT("Finished k_means_bounds:");
+      break;
+    case 6:
+      DEBUG_OUT("Running k_means_minibatch:");
+
+      if (streamed) {
+        iterations = k_means_minibatch_stream(&opts, &n_points, &point_cluster_ids, centroids);
+      }
+      else {
+        iterations = k_means_minibatch(n_points, points, &opts, point_cluster_ids, &centroids);
+      }
+
+      DEBUG_OUT("Finished k_means_minibatch:");
+      break;
+    case 7:
+      DEBUG_OUT("Running k_means_kdtree:");
+
+      iterations = k_means_kdtree(n_points, points, &opts, point_cluster_ids, &centroids);
+
+      DEBUG_OUT("Finished k_means_kdtree:");
+      break;
+    case 8:
+      DEBUG_OUT("Running k_means_outofcore:");
+
+      iterations = k_means_outofcore(&opts, &n_points, &point_cluster_ids, centroids);
+
+      DEBUG_OUT("Finished k_means_outofcore:");
+      break;
+    case 9:
+      DEBUG_OUT("Running k_means_mpi:");
+
+      iterations = k_means_mpi(&opts, &n_points, &point_cluster_ids, centroids);
+
+      DEBUG_OUT("Finished k_means_mpi:");
+      break;
+    case 10:
+      DEBUG_OUT("Running k_means_ivf:");
+
+      iterations = k_means_ivf(n_points, points, &opts, point_cluster_ids, &centroids);
+
+      DEBUG_OUT("Finished k_means_ivf:");
+      break;
   }
 
   //End timer and print out elapsed
   auto end = std::chrono::high_resolution_clock::now();
   auto diff = std::chrono::duration<double, std::milli>(end - start);
 
-  if (opts.algorithm == 0) {
+  // the GPU algorithms time themselves, without the host setup
+  bool gpu_timed = opts.algorithm >= 1 && opts.algorithm <= 3;
+
+  if (!gpu_timed) {
     per_iteration_time = diff.count() / iterations;
   }
   else {
     TIMING_PRINT(printf("Per iteration chrono: %f ms \n", diff.count() / iterations));
   }
+  TIMING_PRINT(printf("phases: assign %f ms, update %f ms, check %f ms\n",
+        phase_times.assign_ms, phase_times.update_ms, phase_times.check_ms));
 
-  printf("%d,%lf\n", iterations, per_iteration_time);
+  // all the MPI ranks have the centroids, only one prints them
+  if (k_means_mpi_root()) {
+    char header[64];
+    snprintf(header, sizeof(header), "%d,%lf\n", iterations, per_iteration_time);
 
-  if (opts.print_centroids) {
-    PRINT_CENTROIDS(centroids, opts.dimensions, opts.n_clusters);
-  }
-  else {
-    printf("clusters:");
-    for (int i = 0; i < n_points; i++)
-      printf(" %d", point_cluster_ids[i]);
+    write_results(&opts, header, n_points, point_cluster_ids, opts.n_clusters, centroids);
   }
 
   free(centroids);
   free(point_cluster_ids);
-  free(points);
+  free_points(points);
+  if (opts.sparse) {
+    free_csr_points(&sparse_points);
+  }
+
+  k_means_mpi_finalize();
 }
@@ -0,0 +1,178 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <pthread.h>
+#include "common.h"
+#include "output.h"
+
+// bytes kept free in a chunk's buffer for one value: an int, or a "%lf " of
+// any double
+#define FORMAT_SLACK 400
+
+struct format_chunk_t {
+  // rows [start, end) of ids, or of the k x d centroids if ids is NULL
+  int start, end;
+  const int *ids;
+  const real *centroids;
+  int d;
+
+  char *buf;
+  size_t len, cap;
+};
+
+static void reserve(format_chunk_t *chunk) {
+  if (chunk->len + FORMAT_SLACK > chunk->cap) {
+    chunk->cap = 2 * chunk->cap + FORMAT_SLACK;
+    chunk->buf = (char *)realloc(chunk->buf, chunk->cap);
+  }
+}
+
+// %d, without the printf machinery
+static char *format_int(char *c, int x) {
+  char digits[12];
+  int n = 0;
+  unsigned int u = x < 0 ? 0u - (unsigned int)x : (unsigned int)x;
+
+  do {
+    digits[n++] = '0' + u % 10;
+    u /= 10;
+  } while (u > 0);
+
+  if (x < 0) {
+    *c++ = '-';
+  }
+  while (n > 0) {
+    *c++ = digits[--n];
+  }
+  return c;
+}
+
+static void *format_ids(void *a) {
+  format_chunk_t *chunk = (format_chunk_t *)a;
+
+  for (int i = chunk->start; i < chunk->end; i++) {
+    reserve(chunk);
+    char *c = chunk->buf + chunk->len;
+    *c++ = ' ';
+    chunk->len = format_int(c, chunk->ids[i]) - chunk->buf;
+  }
+
+  return 0;
+}
+
+// as PRINT_CENTROIDS
+static void *format_centroids(void *a) {
+  format_chunk_t *chunk = (format_chunk_t *)a;
+  int d = chunk->d;
+
+  for (int j = chunk->start; j < chunk->end; j++) {
+    reserve(chunk);
+    char *c = format_int(chunk->buf + chunk->len, j);
+    *c++ = ' ';
+    chunk->len = c - chunk->buf;
+
+    for (int l = 0; l < d; l++) {
+      reserve(chunk);
+      chunk->len += snprintf(chunk->buf + chunk->len, chunk->cap - chunk->len,
+          "%lf ", (double)chunk->centroids[(long)j*d + l]);
+    }
+
+    reserve(chunk);
+    chunk->buf[chunk->len++] = '\n';
+  }
+
+  return 0;
+}
+
+static void write_or_die(FILE *f, const char *path, const void *data, size_t size) {
+  if (fwrite(data, 1, size, f) != size) {
+    std::cerr << path << ": " << strerror(errno) << std::endl;
+    exit(1);
+  }
+}
+
+// the n_rows rows in chunks on n_threads threads, written in order
+static void write_text(FILE *f, const char *path, int n_rows, int n_threads,
+    const int *ids, const real *centroids, int d) {
+  n_threads = n_threads < n_rows ? n_threads : n_rows;
+  n_threads = n_threads > 0 ? n_threads : 1;
+
+  format_chunk_t *chunks = (format_chunk_t *)malloc(n_threads * sizeof(format_chunk_t));
+  pthread_t *threads = (pthread_t *)malloc(n_threads * sizeof(pthread_t));
+  void *(*format)(void *) = ids != NULL ? format_ids : format_centroids;
+
+  for (int t = 0; t < n_threads; t++) {
+    chunks[t].start = (int)((long)n_rows * t / n_threads);
+    chunks[t].end = (int)((long)n_rows * (t + 1) / n_threads);
+    chunks[t].ids = ids;
+    chunks[t].centroids = centroids;
+    chunks[t].d = d;
+    chunks[t].len = 0;
+    // about the size of an id row, it grows for centroids
+    chunks[t].cap = (size_t)(chunks[t].end - chunks[t].start) * 8 + FORMAT_SLACK;
+    chunks[t].buf = (char *)malloc(chunks[t].cap);
+  }
+
+  if (n_threads == 1) {
+    format(&chunks[0]);
+  }
+  else {
+    for (int t = 0; t < n_threads; t++) {
+      HANDLE(pthread_create(&threads[t], NULL, format, (void *)&chunks[t]));
+    }
+    for (int t = 0; t < n_threads; t++) {
+      HANDLE(pthread_join(threads[t], NULL));
+    }
+  }
+
+  for (int t = 0; t < n_threads; t++) {
+    write_or_die(f, path, chunks[t].buf, chunks[t].len);
+    free(chunks[t].buf);
+  }
+
+  free(chunks);
+  free(threads);
+}
+
+void write_results(struct options_t *opts, const char *header, int n_points,
+    const int *ids, int k, const real *centroids) {
+  const char *path = opts->out != NULL ? opts->out : "stdout";
+  FILE *f = stdout;
+  if (opts->out != NULL) {
+    f = fopen(opts->out, "wb");
+    if (f == NULL) {
+      std::cerr << opts->out << ": " << strerror(errno) << std::endl;
+      exit(1);
+    }
+  }
+
+  if (opts->binary_out) {
+    printf("%s", header);
+    fflush(stdout);
+
+    if (opts->print_centroids) {
+      write_or_die(f, path, centroids, (size_t)k * opts->dimensions * sizeof(real));
+    }
+    else {
+      write_or_die(f, path, ids, (size_t)n_points * sizeof(int));
+    }
+  }
+  else {
+    write_or_die(f, path, header, strlen(header));
+
+    if (opts->print_centroids) {
+      write_text(f, path, k, opts->n_threads, NULL, centroids, opts->dimensions);
+    }
+    else {
+      write_or_die(f, path, "clusters:", strlen("clusters:"));
+      write_text(f, path, n_points, opts->n_threads, ids, NULL, 0);
+    }
+  }
+
+  if (f != stdout) {
+    fclose(f);
+  }
+  else {
+    fflush(stdout);
+  }
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "common.h"
+#include "argparse.h"
+
+// The results of a run, after the header line ("iterations,time" or the
+// like): the centroids if opts->print_centroids, else the point ids, to
+// opts->out or stdout.
+//
+// Text is the format of PRINT_CENTROIDS and of "clusters: id id ...",
+// formatted on opts->n_threads threads, a chunk of the rows each into its
+// own buffer, and written a buffer at a time. Binary (opts->binary_out) is
+// the raw k x d reals or n_points int32s, with the header line on stdout.
+void write_results(struct options_t *opts, const char *header, int n_points,
+    const int *ids, int k, const real *centroids);
@@ -0,0 +1,15 @@
+#include "phases.h"
+#include <chrono>
+
+phase_times_t phase_times = {0, 0, 0};
+
+void reset_phase_times() {
+  phase_times.assign_ms = 0;
+  phase_times.update_ms = 0;
+  phase_times.check_ms = 0;
+}
+
+double phase_clock_ms() {
+  return std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
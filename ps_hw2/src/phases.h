@@ -0,0 +1,18 @@
+#pragma once
+
+// Wall time of the phases of the iterations, summed since the last
+// reset_phase_times: assign (the nearest centroids, with the sums when they
+// are fused into it), update (the new centroids) and check (convergence).
+// Timed by the in-memory CPU algorithms (-a 0, 4, 5, 6, 7 and 10, without
+// -R or -K); read by the benchmark, printed by TIMING builds.
+struct phase_times_t {
+  double assign_ms;
+  double update_ms;
+  double check_ms;
+};
+
+extern phase_times_t phase_times;
+
+void reset_phase_times();
+// a monotonic clock, for the phase starts
+double phase_clock_ms();
@@ -1,24 +1,352 @@
 #include "seed.h"
 #include <cstring>
 #include <cstdlib>
+#include <limits>
+#include <pthread.h>
+#include "k_means_kernels.h"
 
-static unsigned long int next = 1;
+static k_means_rand_t next = 1;
 static unsigned long kmeans_rmax = 32767;
+int k_means_rand_r(k_means_rand_t *state) {
+  *state = *state * 1103515245 + 12345;
+  return (unsigned int)(*state/65536) % (kmeans_rmax+1);
+}
+
 int k_means_rand() {
-  next = next * 1103515245 + 12345;
-  return (unsigned int)(next/65536) % (kmeans_rmax+1);
+  return k_means_rand_r(&next);
 }
 
 void k_means_srand(unsigned int seed) {
   next = seed;
 }
 
+void k_means_init_random_centroids_r(int n_points, int d, real *points,
+    int k, real *centroids, k_means_rand_t *rand_state) {
+  for (int i = 0; i < k; i++) {
+    int index = k_means_rand_r(rand_state) % n_points;
+    std::memcpy(&centroids[i * d], &points[index * d], d * sizeof(real));
+  }
+}
+
 void k_means_init_random_centroids(int n_points, int d, real *points,
     int k, real *centroids, int seed) {
   k_means_srand(seed); // cmd_seed is a cmdline arg
+  k_means_init_random_centroids_r(n_points, d, points, k, centroids, &next);
+}
 
-  for (int i = 0; i < k; i++) {
-    int index = k_means_rand() % n_points;
-    std::memcpy(&centroids[i * d], &points[index * d], d * sizeof(real));
+// k-means++ and k-means|| keep, for every point, the squared distance to
+// its nearest center so far; the points are updated in SEED_SLICES fixed
+// slices, split among the threads, and anything summed over the points is
+// summed per slice and then in slice order, so the seeds don't depend on the
+// thread count.
+#define SEED_SLICES 256
+// k-means|| rounds, each sampling SEED_OVERSAMPLING * k candidates on average
+#define SEED_ROUNDS 5
+#define SEED_OVERSAMPLING 2
+
+struct seed_state_t {
+  int n_points, d, n_slices;
+  real *points;
+  nearest_centroids_t nearest_centroids;
+
+  // the centers to fold into dist_2, numbered from centers_start
+  int n_centers, centers_start;
+  const real *centers;
+
+  // squared distance to, and index of, the nearest center so far
+  real *dist_2;
+  int *nearest;
+  // nearest_centroids output, per point
+  int *ids;
+  real *dists;
+
+  // per slice sums of dist_2
+  double *slice_sums;
+
+  // k-means|| sampling: p(pick) = oversampling * dist_2 / phi
+  double oversampling, phi;
+  unsigned long round_seed;
+  bool *picked;
+};
+
+struct seed_thread_t {
+  seed_state_t *state;
+  int slice_start, slice_end;
+  void (*op)(seed_state_t *, int, int, int);
+};
+
+// 30 random bits from the LCG; the draws are separate statements since the
+// operands of | are unsequenced
+static long rand_30(k_means_rand_t *rand_state) {
+  long high = k_means_rand_r(rand_state);
+  return (high << 15) | k_means_rand_r(rand_state);
+}
+
+// a random real in [0, 1) from the LCG
+static double rand_uniform(k_means_rand_t *rand_state) {
+  return rand_30(rand_state) / (double)(1L << 30);
+}
+
+// a random real in [0, 1) for point i, independent of which thread asks
+// (splitmix64 of the round seed and the index)
+static double point_uniform(unsigned long round_seed, long i) {
+  unsigned long z = round_seed + (unsigned long)(i + 1) * 0x9E3779B97F4A7C15UL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+  z ^= z >> 31;
+  return (z >> 11) / 9007199254740992.0;
+}
+
+static void *seed_thread(void *a) {
+  seed_thread_t *args = (seed_thread_t *)a;
+  seed_state_t *state = args->state;
+
+  for (int s = args->slice_start; s < args->slice_end; s++) {
+    int start = (int)((long)state->n_points * s / state->n_slices);
+    int end = (int)((long)state->n_points * (s + 1) / state->n_slices);
+    args->op(state, s, start, end);
+  }
+
+  return 0;
+}
+
+static void run_slices(seed_state_t *state, int n_threads,
+    void (*op)(seed_state_t *, int, int, int)) {
+  if (n_threads > state->n_slices) {
+    n_threads = state->n_slices;
+  }
+
+  seed_thread_t *args = (seed_thread_t *)malloc(n_threads * sizeof(seed_thread_t));
+  pthread_t *threads = (pthread_t *)malloc(n_threads * sizeof(pthread_t));
+
+  for (int t = 0; t < n_threads; t++) {
+    args[t].state = state;
+    args[t].slice_start = (int)((long)state->n_slices * t / n_threads);
+    args[t].slice_end = (int)((long)state->n_slices * (t + 1) / n_threads);
+    args[t].op = op;
+  }
+
+  if (n_threads == 1) {
+    seed_thread(&args[0]);
+  }
+  else {
+    for (int t = 0; t < n_threads; t++) {
+      HANDLE(pthread_create(&threads[t], NULL, seed_thread, (void *)&args[t]));
+    }
+    for (int t = 0; t < n_threads; t++) {
+      HANDLE(pthread_join(threads[t], NULL));
+    }
+  }
+
+  free(args);
+  free(threads);
+}
+
+// fold state->centers into dist_2 / nearest, and sum dist_2 over the slice
+static void update_slice(seed_state_t *state, int slice, int start, int end) {
+  int d = state->d;
+  // a lone center doesn't fill a SIMD register
+  nearest_centroids_t nearest_centroids = state->n_centers == 1 ?
+    nearest_centroids_scalar : state->nearest_centroids;
+
+  nearest_centroids(end - start, d, &state->points[start*d],
+      state->n_centers, state->centers, &state->ids[start], &state->dists[start]);
+
+  double sum = 0;
+  for (int i = start; i < end; i++) {
+    // earlier centers win ties
+    if (state->dists[i] < state->dist_2[i]) {
+      state->dist_2[i] = state->dists[i];
+      state->nearest[i] = state->centers_start + state->ids[i];
+    }
+    sum += state->dist_2[i];
+  }
+
+  state->slice_sums[slice] = sum;
+}
+
+// an op of run_slices, but nothing is summed per slice, so the slice is unnamed
+static void sample_slice(seed_state_t *state, int, int start, int end) {
+  for (int i = start; i < end; i++) {
+    double p = state->oversampling * state->dist_2[i] / state->phi;
+    state->picked[i] = point_uniform(state->round_seed, i) < p;
+  }
+}
+
+// fold centers [centers_start, centers_start + n_centers) in, returns phi
+static double update_distances(seed_state_t *state, int n_threads,
+    const real *centers, int centers_start, int n_centers) {
+  state->centers = centers;
+  state->centers_start = centers_start;
+  state->n_centers = n_centers;
+
+  run_slices(state, n_threads, update_slice);
+
+  double phi = 0;
+  for (int s = 0; s < state->n_slices; s++) {
+    phi += state->slice_sums[s];
+  }
+  return phi;
+}
+
+static void alloc_seed_state(seed_state_t *state, int n_points, int d,
+    real *points) {
+  state->n_points = n_points;
+  state->d = d;
+  state->n_slices = n_points < SEED_SLICES ? n_points : SEED_SLICES;
+  state->points = points;
+  state->nearest_centroids = select_nearest_centroids(0);
+  state->dist_2 = (real *)malloc(n_points * sizeof(real));
+  state->nearest = (int *)malloc(n_points * sizeof(int));
+  state->ids = (int *)malloc(n_points * sizeof(int));
+  state->dists = (real *)malloc(n_points * sizeof(real));
+  state->slice_sums = (double *)malloc(state->n_slices * sizeof(double));
+  state->picked = NULL;
+
+  for (int i = 0; i < n_points; i++) {
+    state->dist_2[i] = std::numeric_limits<real>::max();
+    state->nearest[i] = -1;
+  }
+}
+
+static void free_seed_state(seed_state_t *state) {
+  free(state->dist_2);
+  free(state->nearest);
+  free(state->ids);
+  free(state->dists);
+  free(state->slice_sums);
+  free(state->picked);
+}
+
+// index of the point where the running sum of weights * dist_2 passes
+// target; a NULL dist_2 or weights counts as all 1s
+static int pick_weighted(int n, const real *dist_2, const double *weights,
+    double target) {
+  double sum = 0;
+
+  for (int i = 0; i < n; i++) {
+    sum += (weights == NULL ? 1 : weights[i]) * (dist_2 == NULL ? 1 : dist_2[i]);
+    if (sum > target) {
+      return i;
+    }
+  }
+
+  // rounding left target at the very end; the last point with any weight
+  for (int i = n - 1; i > 0; i--) {
+    if ((weights == NULL ? 1 : weights[i]) * (dist_2 == NULL ? 1 : dist_2[i]) > 0) {
+      return i;
+    }
+  }
+  return 0;
+}
+
+void k_means_init_plus_plus(int n_points, int d, real *points,
+    int k, real *centroids, int seed, int n_threads) {
+  k_means_srand(seed);
+  k_means_init_plus_plus_r(n_points, d, points, k, centroids, &next, n_threads);
+}
+
+void k_means_init_plus_plus_r(int n_points, int d, real *points,
+    int k, real *centroids, k_means_rand_t *rand_state, int n_threads) {
+
+  seed_state_t state;
+  alloc_seed_state(&state, n_points, d, points);
+
+  int index = rand_30(rand_state) % n_points;
+  std::memcpy(&centroids[0], &points[index*d], d * sizeof(real));
+
+  for (int i = 1; i < k; i++) {
+    double phi = update_distances(&state, n_threads, &centroids[(i-1)*d], i-1, 1);
+
+    index = pick_weighted(n_points, state.dist_2, NULL, rand_uniform(rand_state) * phi);
+    std::memcpy(&centroids[i*d], &points[index*d], d * sizeof(real));
   }
+
+  free_seed_state(&state);
+}
+
+void k_means_init_parallel(int n_points, int d, real *points,
+    int k, real *centroids, int seed, int n_threads) {
+  k_means_srand(seed);
+  k_means_init_parallel_r(n_points, d, points, k, centroids, &next, n_threads);
+}
+
+void k_means_init_parallel_r(int n_points, int d, real *points,
+    int k, real *centroids, k_means_rand_t *rand_state, int n_threads) {
+
+  seed_state_t state;
+  alloc_seed_state(&state, n_points, d, points);
+  state.picked = (bool *)malloc(n_points * sizeof(bool));
+  state.oversampling = SEED_OVERSAMPLING * k;
+
+  int capacity = 1 + (SEED_ROUNDS + 1) * SEED_OVERSAMPLING * k;
+  real *candidates = (real *)malloc(capacity * d * sizeof(real));
+
+  int index = rand_30(rand_state) % n_points;
+  std::memcpy(&candidates[0], &points[index*d], d * sizeof(real));
+  int n_candidates = 1;
+
+  state.phi = update_distances(&state, n_threads, candidates, 0, 1);
+
+  for (int r = 0; r < SEED_ROUNDS && state.phi > 0; r++) {
+    unsigned long high = k_means_rand_r(rand_state);
+    state.round_seed = (high << 30) | rand_30(rand_state);
+    run_slices(&state, n_threads, sample_slice);
+
+    // in point order, so the candidates don't depend on the threads
+    int round_start = n_candidates;
+    for (int i = 0; i < n_points; i++) {
+      if (state.picked[i]) {
+        if (n_candidates == capacity) {
+          capacity *= 2;
+          candidates = (real *)realloc(candidates, capacity * d * sizeof(real));
+        }
+        std::memcpy(&candidates[n_candidates*d], &points[i*d], d * sizeof(real));
+        n_candidates++;
+      }
+    }
+
+    state.phi = update_distances(&state, n_threads, &candidates[round_start*d],
+        round_start, n_candidates - round_start);
+  }
+  DEBUG_OUT(n_candidates);
+
+  // weight each candidate by the points nearest to it, and reduce the
+  // candidates to k with weighted k-means++
+  double *weights = (double *)calloc(n_candidates, sizeof(double));
+  for (int i = 0; i < n_points; i++) {
+    weights[state.nearest[i]]++;
+  }
+
+  seed_state_t reduce;
+  alloc_seed_state(&reduce, n_candidates, d, candidates);
+
+  // first center proportional to the weights alone
+  index = pick_weighted(n_candidates, NULL, weights, rand_uniform(rand_state) * n_points);
+  std::memcpy(&centroids[0], &candidates[index*d], d * sizeof(real));
+
+  for (int i = 1; i < k; i++) {
+    update_distances(&reduce, 1, &centroids[(i-1)*d], i-1, 1);
+
+    double phi = 0;
+    for (int c = 0; c < n_candidates; c++) {
+      phi += weights[c] * reduce.dist_2[c];
+    }
+
+    if (phi > 0) {
+      index = pick_weighted(n_candidates, reduce.dist_2, weights, rand_uniform(rand_state) * phi);
+    }
+    else {
+      // fewer distinct candidates than k
+      index = rand_30(rand_state) % n_points;
+      std::memcpy(&centroids[i*d], &points[index*d], d * sizeof(real));
+      continue;
+    }
+    std::memcpy(&centroids[i*d], &candidates[index*d], d * sizeof(real));
+  }
+
+  free_seed_state(&reduce);
+  free_seed_state(&state);
+  free(candidates);
+  free(weights);
 }
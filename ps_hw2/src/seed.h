@@ -2,7 +2,32 @@
 
 #include "common.h"
 
+// k_means_rand draws from one global stream, seeded by k_means_srand; the
+// _r functions draw from a stream of the caller's, seeded by assigning it
+typedef unsigned long k_means_rand_t;
+
 int k_means_rand();
+int k_means_rand_r(k_means_rand_t *state);
+
+void k_means_srand(unsigned int seed);
 
 void k_means_init_random_centroids(int n_points, int d, real *points,
     int k, real *centroids, int seed);
+void k_means_init_random_centroids_r(int n_points, int d, real *points,
+    int k, real *centroids, k_means_rand_t *rand_state);
+
+// k-means++: every next centroid is a point picked with probability
+// proportional to its squared distance to the nearest centroid so far
+void k_means_init_plus_plus(int n_points, int d, real *points,
+    int k, real *centroids, int seed, int n_threads);
+void k_means_init_plus_plus_r(int n_points, int d, real *points,
+    int k, real *centroids, k_means_rand_t *rand_state, int n_threads);
+
+// k-means||: a few rounds that each oversample about 2k candidates the
+// k-means++ way, then weighted k-means++ over the candidates, weighted by
+// the points nearest to them. The distance updates run on n_threads, and the
+// seeds only depend on seed.
+void k_means_init_parallel(int n_points, int d, real *points,
+    int k, real *centroids, int seed, int n_threads);
+void k_means_init_parallel_r(int n_points, int d, real *points,
+    int k, real *centroids, k_means_rand_t *rand_state, int n_threads);